@@ -56,6 +56,9 @@ static cam_obj_t *cam_obj = NULL;
 #define CAMERA_PSRAM_DMA_ENABLED 0
 #endif
 
+/* Drop counters, each field has a single writer (cam_task, ISR or cam_take) */
+static volatile camera_drop_stats_t g_drop_stats;
+
 static volatile bool g_psram_dma_mode = CAMERA_PSRAM_DMA_ENABLED;
 static portMUX_TYPE g_psram_dma_lock = portMUX_INITIALIZER_UNLOCKED;
 
@@ -245,6 +248,7 @@ static bool cam_start_frame(int * frame_pos)
 void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType_t * HPTaskAwoken)
 {
     if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
+        g_drop_stats.event_overflow++;
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
 #if CAM_LOG_SPAM_EVERY_FRAME
@@ -292,6 +296,7 @@ static void cam_task(void *arg)
                     if(!cam_obj->psram_mode){
                         if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                             ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                            g_drop_stats.fb_overflow++;
                             ll_cam_stop(cam_obj);
                             continue;
                         }
@@ -307,6 +312,7 @@ static void cam_task(void *arg)
                         // cam event will be a VSYNC
                         if (cnt + 1 >= cam_obj->frame_copy_cnt) {
                             ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: DMA overflow\r\n"));
+                            g_drop_stats.dma_overflow++;
                             ll_cam_stop(cam_obj);
                             cam_obj->state = CAM_STATE_IDLE;
                             continue;
@@ -329,6 +335,7 @@ static void cam_task(void *arg)
                             memcpy(soi_probe, frame_buffer_event->buf, probe_len);
                             int soi_off = cam_verify_jpeg_soi(soi_probe, probe_len);
                             if (soi_off != 0) {
+                                g_drop_stats.no_soi++;
                                 static uint16_t warn_psram_soi_cnt = 0;
                                 if (soi_off > 0) {
                                     CAM_WARN_THROTTLE(warn_psram_soi_cnt,
@@ -344,6 +351,7 @@ static void cam_task(void *arg)
                         } else {
                             int soi_off = cam_verify_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len);
                             if (soi_off != 0) {
+                                g_drop_stats.no_soi++;
                                 static uint16_t warn_soi_bad_cnt = 0;
                                 if (soi_off > 0) {
                                     CAM_WARN_THROTTLE(warn_soi_bad_cnt,
@@ -370,6 +378,7 @@ static void cam_task(void *arg)
                             if (!cam_obj->psram_mode) {
                                 if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                                     ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                                    g_drop_stats.fb_overflow++;
                                     cnt--;
                                 } else {
                                     frame_buffer_event->len += ll_cam_memcpy(cam_obj,
@@ -407,6 +416,7 @@ static void cam_task(void *arg)
                                 }
                                 //free the popped buffer
                                 cam_give(fb2);
+                                g_drop_stats.fb_replaced++;
                             } else {
                                 //queue is full and we could not pop a frame from it
                                 cam_obj->frames[frame_pos].en = 1;
@@ -761,6 +771,7 @@ camera_fb_t *cam_take(TickType_t timeout)
 
 skip_eoi_check:
 
+            g_drop_stats.no_eoi++;
             CAM_WARN_THROTTLE(warn_eoi_miss_cnt,
                               "NO-EOI - JPEG end marker missing");
             cam_give(dma_buffer);
@@ -801,6 +812,16 @@ bool cam_get_available_frames(void)
     return 0 < uxQueueMessagesWaiting(cam_obj->frame_buffer_queue);
 }
 
+void cam_get_drop_stats(camera_drop_stats_t *stats)
+{
+    stats->fb_overflow    = g_drop_stats.fb_overflow;
+    stats->dma_overflow   = g_drop_stats.dma_overflow;
+    stats->no_soi         = g_drop_stats.no_soi;
+    stats->no_eoi         = g_drop_stats.no_eoi;
+    stats->event_overflow = g_drop_stats.event_overflow;
+    stats->fb_replaced    = g_drop_stats.fb_replaced;
+}
+
 void cam_set_psram_mode(bool enable)
 {
     portENTER_CRITICAL(&g_psram_dma_lock);
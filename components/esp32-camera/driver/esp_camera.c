@@ -520,6 +520,15 @@ bool esp_camera_available_frames(void)
     return cam_get_available_frames();
 }
 
+void esp_camera_get_drop_stats(camera_drop_stats_t *stats)
+{
+    if (s_state == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    cam_get_drop_stats(stats);
+}
+
 esp_err_t esp_camera_reconfigure(const camera_config_t *config)
 {
     if (!config) {
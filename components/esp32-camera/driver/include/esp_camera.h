@@ -169,6 +169,18 @@ typedef struct {
     struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
 } camera_fb_t;
 
+/**
+ * @brief Frames lost inside the driver, by reason
+ */
+typedef struct {
+    uint32_t fb_overflow;       /*!< Frame larger than the frame buffer (FB-OVF) */
+    uint32_t dma_overflow;      /*!< Frame larger than the PSRAM DMA window */
+    uint32_t no_soi;            /*!< JPEG start marker missing (NO-SOI) */
+    uint32_t no_eoi;            /*!< JPEG end marker missing (NO-EOI) */
+    uint32_t event_overflow;    /*!< ISR event queue full (EV-EOF-OVF / EV-VSYNC-OVF) */
+    uint32_t fb_replaced;       /*!< Ready frame replaced by a newer one before it was fetched */
+} camera_drop_stats_t;
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -245,6 +257,13 @@ void esp_camera_return_all(void);
  */
 bool esp_camera_available_frames(void);
 
+/**
+ * @brief Get the number of frames dropped by the driver since init
+ *
+ * @param stats  Output, filled with the per-reason counters
+ */
+void esp_camera_get_drop_stats(camera_drop_stats_t *stats);
+
 /**
  * @brief Enable or disable PSRAM DMA mode at runtime.
  *
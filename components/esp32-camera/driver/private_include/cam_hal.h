@@ -59,6 +59,8 @@ void cam_give_all(void);
 
 bool cam_get_available_frames(void);
 
+void cam_get_drop_stats(camera_drop_stats_t *stats);
+
 void cam_set_psram_mode(bool enable);
 bool cam_get_psram_mode(void);
 
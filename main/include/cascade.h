@@ -0,0 +1,135 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// --- Boosted cascade evaluator ---
+// Runs OpenCV-trained Haar or LBP cascades (BOOST, stumps) in fixed point on
+// integral images. Cascades are converted offline by tools/cascade2bin.py
+// into the layout below. Plain C with no ESP-IDF dependency, like
+// face_detect.h, so the same code is benchmarked on the host.
+
+#define CASCADE_MAGIC       0x53414346u     // "FCAS"
+#define CASCADE_VERSION     1
+#define CASCADE_MAX_STAGES  32
+#define CASCADE_MAX_RECTS   3
+#define CASCADE_MAX_HITS    256             // raw windows kept for grouping per call
+
+// Fixed-point scales of the file
+#define CASCADE_LEAF_SHIFT  16              // leaf values and stage thresholds, Q16
+#define CASCADE_THR_SHIFT   24              // Haar node thresholds, Q24
+
+typedef enum {
+    CASCADE_HAAR = 0,
+    CASCADE_LBP  = 1,
+} cascade_type_t;
+
+// --- File layout ---
+// Little-endian, every record a multiple of 4 bytes:
+//   cascade_file_hdr_t
+//   cascade_stage_t         x n_stages
+//   cascade_haar_node_t     x n_nodes      (or cascade_lbp_node_t)
+//   cascade_haar_feature_t  x n_features   (or cascade_lbp_feature_t)
+// The nodes of each stage follow those of the stage before.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;          // cascade_type_t
+    uint16_t win_w;
+    uint16_t win_h;
+    uint16_t n_stages;
+    uint16_t n_features;
+    uint32_t n_nodes;
+} cascade_file_hdr_t;
+
+typedef struct {
+    uint16_t n_nodes;
+    uint16_t reserved;
+    int32_t  threshold;     // Q16; the window passes when its leaf sum >= threshold
+} cascade_stage_t;
+
+// Haar stump: left leaf when feature / norm < threshold. The feature is the
+// weighted sum of its rectangles; norm is sqrt(A * sqsum - sum^2) over the
+// window less a one pixel border (A its area), as in OpenCV.
+typedef struct {
+    uint16_t feature;
+    uint16_t reserved;
+    int32_t  threshold;     // Q24
+    int32_t  left;          // Q16
+    int32_t  right;
+} cascade_haar_node_t;
+
+// LBP stump: left leaf when the feature's 8-bit code is in `subset`
+typedef struct {
+    uint16_t feature;
+    uint16_t reserved;
+    int32_t  left;          // Q16
+    int32_t  right;
+    uint32_t subset[8];
+} cascade_lbp_node_t;
+
+typedef struct {
+    uint8_t x, y, w, h;
+    int8_t  weight;         // whole weights only; 0 = rectangle unused
+    uint8_t reserved[3];
+} cascade_rect_t;
+
+typedef struct {
+    cascade_rect_t rect[CASCADE_MAX_RECTS];
+} cascade_haar_feature_t;
+
+// 3x3 grid of w x h blocks with its top left corner at x, y
+typedef struct {
+    uint8_t x, y, w, h;
+} cascade_lbp_feature_t;
+
+// --- Evaluation ---
+
+// Parsed cascade; points into the loaded file, which must stay alive
+typedef struct {
+    cascade_type_t type;
+    int win_w;
+    int win_h;
+    int n_stages;
+    int n_features;
+    uint32_t n_nodes;
+    const cascade_stage_t *stages;
+    const void *nodes;
+    const void *features;
+} cascade_t;
+
+typedef struct {
+    int stride;             // window step in pixels of each pyramid level
+    int scale_step_q8;      // pyramid factor x256, e.g. 307 = 1.2
+    int min_neighbors;      // a detection needs more overlapping raw hits than this
+} cascade_params_t;
+
+// Accumulated by cascade_detect() when passed in
+typedef struct {
+    uint32_t windows;
+    uint32_t rejected[CASCADE_MAX_STAGES];  // windows that stopped at stage i
+    uint32_t hits;                          // windows that passed every stage
+} cascade_stats_t;
+
+typedef struct {
+    int16_t  x, y, w, h;    // image pixels
+    uint16_t neighbors;     // raw hits merged into this one
+} cascade_hit_t;
+
+// Check a converted cascade and point `c` into it. `data` must be 4-byte
+// aligned. Returns false for anything malformed or out of range.
+bool cascade_load(cascade_t *c, const void *data, size_t len);
+
+size_t cascade_scratch_size(const cascade_t *c, int width, int height);
+
+// Slide the window over a pyramid of `luma` (width x height, 8 bit). Each
+// level is resampled and turned into its integral image (and, for Haar, the
+// squared integral) in one pass. Overlapping hits are grouped; returns the
+// number of groups written to `out`, most neighbors first.
+int cascade_detect(const cascade_t *c, const cascade_params_t *p,
+                   const uint8_t *luma, int width, int height, void *scratch,
+                   cascade_hit_t *out, int max_out, cascade_stats_t *stats);
+
+#endif // CASCADE_H
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -16,6 +17,10 @@
 #include "esp_vfs_fat.h"
 #include "esp_http_server.h"
 #include "esp_camera.h"
+#include "frame_ref.h"
+#include "frame_ring.h"
+#include "drop_stats.h"
+#include "token_bucket.h"
 
 // ---------------- Wi-Fi ----------------
 #define MAX_WIFI        5
@@ -36,27 +41,175 @@ extern volatile int current_angleY;
 extern volatile int target_angleX;
 extern volatile int target_angleY;
 
-// ---------------- Frames (double buffer) ----------------
-typedef struct {
-    camera_fb_t *fb[2];   // два буфера
-    int write_index;      // индекс записи
-    int read_index;       // индекс чтения
-    bool ready[2];        // готовность кадра
-} frame_double_buffer_t;
-
-extern frame_double_buffer_t frame_buffer;
+// ---------------- Camera ----------------
+// Settings at init; QCTL below may lower both at run time
+#define CAMERA_FRAME_SIZE   FRAMESIZE_VGA
+#define CAMERA_JPEG_QUALITY 12      // 0..63, lower is better
+
+// ---------------- Auto Quality ----------------
+// Closed loop on JPEG quality and frame size, see quality_ctl.h
+#define QCTL_ENABLED            1
+#define QCTL_PERIOD_MS          1000
+#define QCTL_TARGET_KBPS        4000    // sensor stream bitrate budget
+#define QCTL_TARGET_LATENCY_MS  150     // mean capture -> last byte to a viewer's socket, minus shaper holds
+#define QCTL_CONGESTED_PCT      10      // frames due to a viewer but skipped because its link fell behind
+#define QCTL_HYSTERESIS_PCT     15      // dead band around each target
+#define QCTL_HOLD_DOWN          2       // periods over budget before a step down
+#define QCTL_HOLD_UP            5       // periods under budget before a step up
+#define QCTL_QUALITY_MIN        CAMERA_JPEG_QUALITY
+#define QCTL_QUALITY_MAX        40
+#define QCTL_QUALITY_STEP       4
+
+// ---------------- Face Detection ----------------
+// Detection task on a reduced decode of the newest frame, see face_task.h
+#define FACE_DETECT_ENABLED 1
+#define FACE_DECODE_SCALE   4       // 4 or 8: decode at 1/4 or 1/8 of the sensor size
+
+// Cascade from tools/cascade2bin.py; the skin detector runs when it is missing
+#define FACE_CASCADE_PATH       "/sdcard/face.cas"
+#define FACE_CASCADE_MAX_BYTES  (256 * 1024)
+#define CASCADE_STRIDE          2       // window step, pixels of each pyramid level
+#define CASCADE_SCALE_STEP_Q8   307     // pyramid factor x256 (1.2)
+#define CASCADE_MIN_NEIGHBORS   3
+
+// ---------------- Neural Network Model ----------------
+// int8 model in its own flash partition, see model_store.h
+#define NN_MODEL_ENABLED        1
+#define MODEL_PARTITION         "model"     // partitions.csv
+#define MODEL_PARTITION_SUBTYPE 0x40        // first custom data subtype
+#define NN_MODEL_MAX_OPS        64
+#define NN_INTERNAL_BUDGET      (48 * 1024) // DRAM also holds camera DMA and httpd buffers
+
+// ---------------- Frames (ring) ----------------
+#define FRAME_RING_DEPTH    2       // power of two, <= FRAME_RING_MAX_DEPTH
+
+// Captured frames waiting for stream_task; oldest is dropped when full
+extern frame_ring_t frame_ring;
+
+// Notified by the capture task every time a new frame is published
+extern TaskHandle_t stream_task_handle;
 
 extern volatile uint32_t total_frames_captured;
 extern volatile uint32_t total_frames_sent;
-extern volatile uint32_t total_frames_dropped;
 
-// ---------------- MJPEG Client ----------------
+// ---------------- MJPEG Clients ----------------
+#define MAX_STREAM_CLIENTS  3
+#define STREAM_DEFAULT_FPS  20
+#define STREAM_MAX_FPS      30
+#define WS_ACK_WINDOW       2       // frames a WebSocket client may have unacked
+#define WS_RX_MAX           144     // largest upstream WebSocket message + header
+
+typedef enum {
+    STREAM_MJPEG,           // multipart/x-mixed-replace over HTTP
+    STREAM_WS,              // one binary WebSocket message per frame
+} stream_kind_t;
+
+// ---------------- Bandwidth Shaper ----------------
+// Token buckets on the stream sockets, in bytes per second (0 = no cap).
+// Each frame is spread over SHAPER_SPREAD_PCT of its client's frame interval
+// and handed to lwIP in chunks of at most SHAPER_BURST_BYTES, so a frame
+// no longer fills the Wi-Fi TX queue in one go ahead of control traffic.
+// Adjustable at run time through /shaper.
+#define SHAPER_ENABLED      1
+#define SHAPER_CLIENT_BPS   (512 * 1024)    // per viewer
+#define SHAPER_TOTAL_BPS    (1024 * 1024)   // all viewers together
+#define SHAPER_BURST_BYTES  2920            // two TCP segments
+#define SHAPER_SPREAD_PCT   75
+
+// ---------------- Frame Long-Poll ----------------
+// /frame?after=SEQ&timeout=MS, see frame_poll.h. Each parked request holds
+// an httpd session, budgeted separately from the control sockets.
+#define FRAME_POLL_MAX_WAITERS  2
+#define FRAME_POLL_DEFAULT_MS   5000
+#define FRAME_POLL_MAX_MS       30000
+
+// ---------------- HTTP Server ----------------
+// Sockets of the single httpd instance kept for non-stream requests.
+// /stream, /ws/stream and parked /frame requests are refused once taking
+// them would leave fewer than CONTROL_SOCKETS sessions free.
+#define CONTROL_SOCKETS     3
+#define HTTPD_SESSIONS      (MAX_STREAM_CLIENTS + FRAME_POLL_MAX_WAITERS + CONTROL_SOCKETS)
+#define HTTPD_OWN_SOCKETS   3       // listen + ctrl, httpd_start() keeps one more in reserve
+#define LEGACY_STREAM_PORT  81
+
+// ---------------- RTSP Server ----------------
+#define RTSP_PORT           554
+#define RTSP_MAX_SESSIONS   2
+
+// ---------------- UDP / Multicast Stream ----------------
+// Optional: one copy of every frame to a LAN group, see mcast_stream.h.
+// A unicast address in MCAST_GROUP streams to a single receiver instead.
+#define MCAST_ENABLED       0
+#define MCAST_GROUP         "239.255.0.1"
+#define MCAST_PORT          5005
+#define MCAST_TTL           1       // stay on the local network
+#define MCAST_FEC_GROUP     4       // XOR parity per 4 fragments (+25%), 0 = off
+
+// ---------------- Camera Frame Buffers ----------------
+// Every driver buffer that can be held at the same moment. A viewer's send
+// may take up to its stall timeout, so at most VIEWER_FB_MAX of them run on
+// a driver buffer; further viewers send a PSRAM copy (frame_ref_copy).
+// Each pending slot (viewers, transcode, face, RTSP, multicast) only ever
+// holds the newest frame or, while stream_task fans out, the one before it.
+#define VIEWER_FB_MAX       1
+#define CAMERA_FB_WORST_CASE ( \
+      2                     /* driver: one filling, one done (GRAB_LATEST) */ \
+    + 1                     /* capture task, between fb_get and the ring */ \
+    + FRAME_RING_DEPTH      /* waiting for stream_task */ \
+    + 2                     /* newest frame and the one it replaces */ \
+    + VIEWER_FB_MAX         /* /stream and /ws/stream sends in flight */ \
+    + 1                     /* transcoder input */ \
+    + FACE_DETECT_ENABLED   /* face decode input */ \
+    + 1                     /* RTSP packetizer */ \
+    + MCAST_ENABLED         /* multicast fragmenter */ \
+    + 1                     /* httpd task answering /capture or /frame */ \
+    + 1)                    /* frame_poll task answering a parked /frame */
+
 typedef struct {
     int connected;
-    httpd_req_t *req;
+    httpd_req_t *req;         // detached (async) request, keeps httpd off the socket
+    int fd;                   // non-blocking session socket owned by the stream engine
+    stream_kind_t kind;
+    int profile;              // transcode profile, 0 = sensor JPEG
+    uint8_t scale;
+    frame_ref_t *pending;     // newest frame not yet started, NULL if none
+
+    // Frame being written, engine only
+    frame_ref_t *inflight;
+    bool     inflight_fb;     // inflight is a driver buffer, counted against VIEWER_FB_MAX
+    struct iovec iov[3];      // MJPEG: boundary, part header, JPEG (or the response header
+                              // alone before the first frame); WS: header, JPEG
+    int iov_cnt;
+    int iov_first;            // first unfinished iov entry
+    char part_buf[160];
+    int64_t send_start_us;
+    int64_t last_progress_us;
+
+    // Pacing, engine only
+    uint32_t min_interval_us; // per-client frame rate cap
+    int64_t  rate_slot_us;    // decimation schedule: slot of the last frame sent
+    uint32_t rate_Bps;        // smoothed link throughput, 0 = not measured yet
+    uint32_t send_us;         // smoothed time to hand one frame to the socket
+    int64_t  next_due_us;     // earliest time the next frame may go out
+    int64_t  rate_due_us;     // when the frame rate alone lets the next frame go; clients_lock
+    bool     congested;       // pacing: the link, not the frame rate, holds the next frame back
+
+    // Shaper, engine only
+    token_bucket_t bucket;    // this viewer's share, rate set per frame
+    int64_t  shape_due_us;    // in-flight frame waits for tokens until then, 0 = not waiting
+    bool     shaped;          // the shaper held back part of the current frame
+    int64_t  shape_since_us;  // start of the current shaper hold, 0 = not held
+    int64_t  shape_held_us;   // time the shaper held back the current frame
+
+    // WebSocket upstream, engine only
+    uint8_t  rx_buf[WS_RX_MAX];
+    size_t   rx_len;
+    bool     acks;            // client acknowledges frames, send at most WS_ACK_WINDOW ahead
+    uint32_t unacked[WS_ACK_WINDOW];  // seqs sent and not acked yet, oldest first
+    uint8_t  unacked_cnt;
 } mjpeg_client_t;
 
-extern mjpeg_client_t mjpeg_client;
+extern mjpeg_client_t mjpeg_clients[MAX_STREAM_CLIENTS];
 
 // ---------------- Wi-Fi Event ----------------
 extern EventGroupHandle_t wifi_event_group;
@@ -72,8 +225,7 @@ extern const EventBits_t WIFI_CONNECTED_BIT;
 #define MAX_FRAME_SIZE  (60 * 1024)
 #define CONFIG_FILE_PATH "/sdcard/config.txt"
 
-extern httpd_handle_t stream_server;
-extern httpd_handle_t control_server;
+extern httpd_handle_t web_server;
 
 // ---------------- Tasks ----------------
 void camera_capture_task(void *arg);
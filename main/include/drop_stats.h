@@ -0,0 +1,34 @@
+#ifndef DROP_STATS_H
+#define DROP_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Why a captured frame never reached a client
+typedef enum {
+    DROP_RING_OVERWRITE,    // capture: frame_ring full, oldest released
+    DROP_NO_WRAPPER,        // capture: no free frame_ref_t
+    DROP_RING_STALE,        // stream_task: superseded before stream_task got to it
+    DROP_BAD_JPEG,          // stream_task: failed the SOI/EOI sanity check
+    DROP_CLIENT_RATE,       // client: replaced while the client waited out its frame interval (?fps=N
+                            // decimation; not a loss, left out of drop_total())
+    DROP_CLIENT_CONGESTED,  // client: replaced after it was due, while its link was busy or draining
+    DROP_CLIENT_NO_MEM,     // client: over VIEWER_FB_MAX and no PSRAM for a copy
+    DROP_SEND_FAIL,         // client: socket error while sending
+    DROP_TRANSCODE_BUSY,    // transcoder: replaced while the previous frame was re-encoded
+    DROP_REASON_MAX
+} drop_reason_t;
+
+void drop_count(drop_reason_t reason, uint32_t n);
+
+// App drops of one reason since boot
+uint32_t drop_get(drop_reason_t reason);
+
+// App drops plus driver drops (esp_camera_get_drop_stats), without
+// DROP_CLIENT_RATE
+uint32_t drop_total(void);
+
+// {"app":{...},"driver":{...}} with one counter per reason
+int drop_stats_json(char *buf, size_t len);
+
+#endif // DROP_STATS_H
@@ -0,0 +1,42 @@
+#ifndef FACE_DETECT_H
+#define FACE_DETECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cascade.h"
+
+// --- Face detector interface ---
+// Plain C with no ESP-IDF dependency, so detectors also build on the host
+// (tools/face_bench). Input is the big-endian RGB565 that esp_jpeg_decode()
+// produces with swap_color_bytes set; boxes are in the same pixel grid.
+
+typedef struct {
+    int16_t x, y;       // top left
+    int16_t w, h;
+    uint8_t score;      // detector confidence, 0..255
+} face_box_t;
+
+typedef struct {
+    const char *name;
+
+    // Scratch bytes detect() needs for a width x height image
+    size_t (*scratch_size)(int width, int height);
+
+    // Find faces in `rgb565`. `scratch` holds scratch_size() bytes and is not
+    // kept between calls. Returns the number of boxes written (<= max_boxes),
+    // best first by the detector's own ranking.
+    int (*detect)(const uint8_t *rgb565, int width, int height, void *scratch,
+                  face_box_t *boxes, int max_boxes);
+} face_detector_t;
+
+// Skin-colour blobs with face-like shape (face_skin.c), largest first.
+// Cheap; finds faces and, sometimes, hands. Images must have at most
+// 65535 pixels.
+extern const face_detector_t face_detector_skin;
+
+// Boosted Haar/LBP cascade (face_cascade.c). Finds nothing until
+// face_cascade_set() has given it a loaded cascade; `stats` may be NULL.
+extern const face_detector_t face_detector_cascade;
+void face_cascade_set(const cascade_t *c, const cascade_params_t *p, cascade_stats_t *stats);
+
+#endif // FACE_DETECT_H
@@ -0,0 +1,35 @@
+#ifndef FACE_TASK_H
+#define FACE_TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "face_detect.h"
+#include "frame_ref.h"
+
+#define FACE_MAX_BOXES      8
+
+// Detections for one frame, boxes in sensor pixels
+typedef struct {
+    uint32_t seq;           // frame_ref_t::seq of the frame analysed, 0 = none yet
+    int64_t  capture_us;
+    int64_t  done_us;       // when the boxes were published
+    uint16_t width;         // sensor frame size the boxes refer to
+    uint16_t height;
+    int      count;
+    face_box_t boxes[FACE_MAX_BOXES];
+} face_result_t;
+
+// Start the detection task (FACE_DETECT_ENABLED only)
+void face_task_init(void);
+
+// Hand the newest sensor frame to the detector (takes its own ref). A frame
+// still waiting is replaced, so detection always runs on the newest one.
+void face_submit(frame_ref_t *ref);
+
+// Copy of the latest published result
+void face_result_get(face_result_t *out);
+
+// {"seq":..,"capture_us":..,"width":..,"height":..,"faces":[..],"stats":{..}}
+int face_json(char *buf, size_t len);
+
+#endif // FACE_TASK_H
@@ -0,0 +1,40 @@
+#ifndef FRAME_POLL_H
+#define FRAME_POLL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "frame_ref.h"
+
+// --- Long-poll frame pull ---
+// GET /frame?after=SEQ&timeout=MS answers with the newest frame once its
+// sequence number is past SEQ, or 204 when MS pass first. Both carry
+// X-Frame-Seq, so a consumer passing back the last seq it got never sees a
+// frame twice and never spins. Frames published while the consumer is busy
+// are skipped, not queued: it always gets the newest one.
+
+// Start the task that answers parked requests
+void frame_poll_init(void);
+
+// Park `req` until a frame newer than `after` is published or `timeout_ms`
+// pass. The request is detached from the httpd worker and answered by the
+// poll task. Returns ESP_ERR_NO_MEM when FRAME_POLL_MAX_WAITERS are parked.
+esp_err_t frame_poll_wait(httpd_req_t *req, uint32_t after, uint32_t timeout_ms);
+
+// Send `ref` as the response, with the same metadata headers as /capture
+esp_err_t frame_poll_send_frame(httpd_req_t *req, const frame_ref_t *ref);
+
+// Send 204 No Content carrying the newest seq (0 before the first frame)
+esp_err_t frame_poll_send_timeout(httpd_req_t *req, const frame_ref_t *latest);
+
+// A frame was published: answer the waiters it satisfies
+void frame_poll_notify(void);
+
+// Wrap-safe "seq is newer than after"
+static inline bool frame_seq_after(uint32_t seq, uint32_t after)
+{
+    return (int32_t)(seq - after) > 0;
+}
+
+#endif // FRAME_POLL_H
@@ -0,0 +1,50 @@
+#ifndef FRAME_REF_H
+#define FRAME_REF_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "esp_camera.h"
+
+// Number of camera frame buffers requested from the driver. Must cover
+// CAMERA_FB_WORST_CASE in common.h, every holder at once, or
+// esp_camera_fb_get() stalls the capture task (asserted in camera.c).
+// VGA JPEG buffers are 60 KB each, in PSRAM.
+#define CAMERA_FB_COUNT     13
+
+// ---------------- Shared frame ----------------
+// A camera frame shared by reference count between the capture task and every
+// client that still has to send it. The driver buffer goes back to the camera
+// when the last holder calls frame_ref_put().
+// Transcoded frames use the same handle around a heap buffer (`heap`); the
+// last put frees it instead.
+typedef struct {
+    camera_fb_t *fb;
+    uint32_t     seq;        // monotonically increasing frame number
+    int64_t      capture_us; // fb->timestamp as esp_timer microseconds
+    int64_t      publish_us; // when the capture task pushed it to frame_ring
+    atomic_uint  refs;
+    bool         heap;       // fb and fb->buf are malloc'd, not a driver frame
+} frame_ref_t;
+
+// Wrap a frame taken from esp_camera_fb_get(). Returns NULL (and gives the
+// frame back to the driver) if no wrapper is free. The caller owns one reference.
+frame_ref_t *frame_ref_from_fb(camera_fb_t *fb);
+
+// Wrap a malloc'd JPEG derived from `src` (same seq and capture time). Takes
+// ownership of `buf`, freeing it if the wrapper cannot be allocated (NULL).
+// The caller owns one reference.
+frame_ref_t *frame_ref_from_jpeg(uint8_t *buf, size_t len, uint16_t width, uint16_t height,
+                                 const frame_ref_t *src);
+
+// Copy a driver frame into PSRAM as a heap frame (same seq and capture time)
+// so a slow holder does not keep the driver buffer. NULL when out of memory.
+// The caller owns one reference; `src` is left alone.
+frame_ref_t *frame_ref_copy(const frame_ref_t *src);
+
+// Take an additional reference.
+frame_ref_t *frame_ref_get(frame_ref_t *ref);
+
+// Drop a reference; the last one returns the frame buffer to the driver.
+void frame_ref_put(frame_ref_t *ref);
+
+#endif // FRAME_REF_H
@@ -0,0 +1,51 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "frame_ref.h"
+
+#define FRAME_RING_MAX_DEPTH    8       // upper bound, depth must be a power of two
+
+// What push does when the ring is full
+typedef enum {
+    FRAME_RING_OVERWRITE_OLDEST,    // release the oldest frame and take its place
+    FRAME_RING_BLOCK_PRODUCER,      // wait until a consumer frees a slot
+} frame_ring_policy_t;
+
+typedef struct {
+    atomic_uint  seq;               // cell turn: pos = free for write, pos+1 = holds data
+    frame_ref_t *ref;
+} frame_ring_cell_t;
+
+// Bounded lock-free MPMC ring of frame handles (Vyukov sequence-number queue).
+// Each stored handle carries one reference owned by the ring.
+typedef struct {
+    frame_ring_cell_t   cells[FRAME_RING_MAX_DEPTH];
+    uint32_t            mask;
+    frame_ring_policy_t policy;
+    atomic_uint         head;           // next position to write
+    atomic_uint         tail;           // next position to read
+    atomic_uint         overwritten;    // frames released by OVERWRITE_OLDEST
+    atomic_uint         waiting;        // producers parked on space_sem
+    SemaphoreHandle_t   space_sem;      // BLOCK_PRODUCER wakeup
+} frame_ring_t;
+
+esp_err_t frame_ring_init(frame_ring_t *r, uint32_t depth, frame_ring_policy_t policy);
+
+// Store a frame; the ring takes over the caller's reference on success.
+// With BLOCK_PRODUCER waits up to `wait` ticks and returns ESP_ERR_TIMEOUT
+// (reference still owned by the caller) if no slot frees up.
+esp_err_t frame_ring_push(frame_ring_t *r, frame_ref_t *ref, TickType_t wait);
+
+// Take the oldest frame, or NULL if empty. The caller owns the returned reference.
+frame_ref_t *frame_ring_pop(frame_ring_t *r);
+
+// Drain the ring and return only the newest frame, releasing older ones.
+// `skipped` (optional) receives the number of frames released.
+frame_ref_t *frame_ring_pop_latest(frame_ring_t *r, uint32_t *skipped);
+
+#endif // FRAME_RING_H
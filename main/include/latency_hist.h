@@ -0,0 +1,30 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pipeline stages, all measured with esp_timer_get_time() in microseconds
+typedef enum {
+    LAT_CAPTURE_TO_PUBLISH,     // fb->timestamp (first DMA of frame) -> pushed to frame_ring
+    LAT_RING_WAIT,              // pushed to frame_ring -> taken by stream_task
+    LAT_SEND,                   // one client's send call(s) for a frame
+    LAT_CAPTURE_TO_SENT,        // fb->timestamp -> last byte handed to the socket
+    LAT_FACE_DECODE,            // scaled decode for the face detector
+    LAT_FACE_DETECT,            // face detector run on the decoded image
+    LAT_CAPTURE_TO_FACES,       // fb->timestamp -> face boxes published
+    LAT_STAGE_MAX
+} lat_stage_t;
+
+// Bucket i counts samples in [2^(i-1), 2^i) us, bucket 0 is < 1 us.
+// The last bucket (~4.2 s and above) is open ended.
+#define LAT_BUCKETS     24
+
+void latency_record(lat_stage_t stage, int64_t us);
+
+void latency_reset(void);
+
+// Per stage: count, mean, max, p50/p90/p99 (bucket upper bounds) and raw buckets
+int latency_json(char *buf, size_t len);
+
+#endif // LATENCY_HIST_H
@@ -0,0 +1,53 @@
+#ifndef MCAST_STREAM_H
+#define MCAST_STREAM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "frame_ref.h"
+
+// --- Multicast wire format ---
+// Every JPEG is sent once to MCAST_GROUP:MCAST_PORT, split into datagrams of
+// at most MCAST_DATAGRAM bytes. Each datagram is this header followed by
+// frag_len bytes of the JPEG at `offset`. All fields little-endian.
+// A receiver collects fragments by frame_seq until frag_count have arrived;
+// a newer frame_seq abandons an incomplete frame.
+//
+// FEC: with fec_group = N > 0, every run of N data fragments (the last run
+// may be shorter) is followed by a parity datagram (MCAST_FLAG_PARITY) whose
+// payload is the XOR of those fragments, each zero-padded to the parity
+// length. Its frag_idx and offset are those of the run's first fragment.
+// One lost fragment per run is rebuilt from the parity and the others; the
+// length of a rebuilt fragment follows from frame_len, since every fragment
+// but the last carries MCAST_FRAG_PAYLOAD bytes.
+// tools/mcast_recv.py is a reference receiver, tools/mcast_send.py a host
+// sender for checking it against loss without the device.
+#define MCAST_MAGIC         0x4A4D      // "MJ"
+#define MCAST_VERSION       2           // 2 added fec_group and parity datagrams
+#define MCAST_DATAGRAM      1400
+
+#define MCAST_FLAG_PARITY   0x01
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t  version;
+    uint8_t  flags;         // MCAST_FLAG_*
+    uint32_t frame_seq;     // frame_ref_t::seq
+    uint32_t frame_len;     // JPEG bytes in the whole frame
+    uint32_t offset;        // where this fragment goes in the frame
+    uint16_t frag_idx;
+    uint16_t frag_count;    // data fragments, parity not included
+    uint16_t frag_len;      // payload bytes after the header
+    uint16_t fec_group;     // data fragments per parity datagram, 0 = no FEC
+    int64_t  capture_us;    // capture time, esp_timer microseconds
+} mcast_frag_hdr_t;
+
+#define MCAST_FRAG_PAYLOAD  (MCAST_DATAGRAM - sizeof(mcast_frag_hdr_t))
+
+// Open the multicast socket and start the sender task (MCAST_ENABLED only)
+esp_err_t mcast_stream_start(void);
+
+// Queue a published frame for the group (takes its own ref). No-op when the
+// sender is not running.
+void mcast_publish(frame_ref_t *ref);
+
+#endif // MCAST_STREAM_H
@@ -0,0 +1,29 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "nn.h"
+
+// --- Model partition ---
+// At boot the MODEL_PARTITION image (tools/model_pack.py) is memory-mapped,
+// its format version and CRC checked, and its activation arenas planned: up
+// to NN_INTERNAL_BUDGET bytes of internal RAM, the rest in PSRAM. The arenas
+// are allocated by the first model_store_get(). Weights stay in flash and
+// are read through the cache. A new model is installed by flashing that
+// partition alone.
+
+// Map and check the model (NN_MODEL_ENABLED only). Without a usable image
+// the rest of the firmware runs as before.
+void model_store_init(void);
+
+// The loaded model and its arenas, or NULL when there is none or the arenas
+// cannot be allocated. Inference needs the arenas to itself; one task owns
+// them and is the only caller.
+const nn_model_t *model_store_get(nn_arena_t *arena);
+
+// {"loaded":..,"name":..,"bytes":..,"crc32":..,"plan":{nn_plan_json}} or the
+// reason nothing was loaded
+int model_json(char *buf, size_t len);
+
+#endif // MODEL_STORE_H
@@ -0,0 +1,111 @@
+#ifndef NN_H
+#define NN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// --- Int8 inference ---
+// Small runtime for quantized CNNs (BlazeFace / YuNet class) with
+// TFLite-compatible int8 arithmetic: int32 accumulation, per-channel
+// requantization by a Q31 multiplier and a power-of-two shift with
+// gemmlowp's rounding. Activations are HWC int8 and live in two arenas laid
+// out once by nn_plan(), so nn_run() allocates nothing. Plain C with no
+// ESP-IDF dependency; tools/nn_check holds it bit-exact against a naive
+// reference on the host.
+
+#define NN_MAX_TENSORS      64
+#define NN_ARENA_ALIGN      16
+
+// Where a tensor lives. Internal RAM is small and fast; PSRAM takes the rest.
+typedef enum {
+    NN_MEM_INTERNAL = 0,
+    NN_MEM_PSRAM,
+    NN_MEM_REGIONS,
+} nn_mem_t;
+
+// Base of each region's arena, m->arena_size[i] bytes, NN_ARENA_ALIGN aligned
+typedef struct {
+    void *base[NN_MEM_REGIONS];
+} nn_arena_t;
+
+typedef enum {
+    NN_CONV2D = 0,      // weights [out_c][kh][kw][in_c]
+    NN_DWCONV2D,        // depthwise, multiplier 1: weights [kh][kw][c]
+    NN_MAXPOOL,
+    NN_AVGPOOL,         // mean of the taps inside the input
+    NN_RELU,            // clamp to act_min..act_max; may run in place
+} nn_op_type_t;
+
+typedef struct {
+    uint16_t h, w, c;
+    int8_t   zero_point;
+    uint8_t  region;    // nn_mem_t, set by nn_plan()
+    uint32_t offset;    // into the region's arena, set by nn_plan()
+} nn_tensor_t;
+
+// Output shape comes from the output tensor. Padding below and to the right
+// is whatever the shapes imply (TFLite SAME or VALID); padded taps are
+// skipped, which is the same as padding with the input zero point.
+typedef struct {
+    uint8_t  type;              // nn_op_type_t
+    uint8_t  kh, kw;
+    uint8_t  stride;
+    uint8_t  pad_t, pad_l;
+    int8_t   act_min, act_max;  // fused activation, quantized (ReLU: act_min = zero point)
+    uint16_t input, output;     // tensor indices
+    // Convolutions only, per output channel
+    const int8_t  *weights;     // symmetric, zero point 0
+    const int32_t *bias;
+    const int32_t *multiplier;  // Q31, in [2^30, 2^31) or 0
+    const int8_t  *shift;       // > 0 left, < 0 right; -31..7
+} nn_op_t;
+
+typedef struct {
+    int n_tensors;
+    nn_tensor_t *tensors;
+    int n_ops;
+    const nn_op_t *ops;
+    int input;                  // tensor nn_input_rgb565() fills
+    int output;
+    size_t arena_size[NN_MEM_REGIONS];  // set by nn_plan()
+} nn_model_t;
+
+// Check the ops against the tensor shapes, then lay out the arenas. Ops
+// must be in execution order and only read tensors that are the model input
+// or written by an earlier op; every tensor must be one or the other.
+//
+// A tensor is live from the op that writes it to the last op that reads
+// it. The model input lives from before the first op; m->output and any
+// tensor no later op reads (a detector's extra heads) live to the end.
+// Tensors whose lifetimes do not overlap share memory, packed largest
+// first into the lowest gap that fits.
+//
+// Tensors are offered to internal RAM hottest first, by kernel accesses
+// per byte, and stay there while that arena packs into `internal_budget`
+// bytes. The rest go to PSRAM. Returns false for an inconsistent model.
+bool nn_plan(nn_model_t *m, size_t internal_budget);
+
+// Peak-memory report of a planned model as JSON: arena sizes against the
+// unshared total, the largest set of tensors live at one op, and every
+// tensor's size, lifetime and place. Returns snprintf's length.
+int nn_plan_json(const nn_model_t *m, char *buf, size_t len);
+
+static inline int8_t *nn_tensor_data(const nn_model_t *m, const nn_arena_t *arena, int tensor)
+{
+    const nn_tensor_t *t = &m->tensors[tensor];
+    return (int8_t *)arena->base[t->region] + t->offset;
+}
+
+// Fill the 3-channel input tensor from an RGB565 frame of any size
+// (nearest neighbour). Pixels map to 0..255 at scale 1/255, so the input
+// tensor's zero point is added to them. `big_endian` is the layout esp_jpeg
+// writes with swap_color_bytes set (face_task.c); jpg2rgb565() leaves it
+// clear.
+void nn_input_rgb565(const nn_model_t *m, const nn_arena_t *arena, const uint8_t *rgb565,
+                     int width, int height, bool big_endian);
+
+// Run every op
+void nn_run(const nn_model_t *m, const nn_arena_t *arena);
+
+#endif // NN_H
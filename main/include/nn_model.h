@@ -0,0 +1,64 @@
+#ifndef NN_MODEL_H
+#define NN_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nn.h"
+
+// --- Model image ---
+// What tools/model_pack.py writes and the `model` partition holds. The
+// image is used in place: ops point straight at its weight blobs, so once
+// the partition is memory-mapped the kernels read weights through the flash
+// cache and nothing is copied to RAM. Little-endian:
+//   nn_model_hdr_t
+//   nn_model_tensor_t  x n_tensors      activations, in nn_tensor_t order
+//   nn_model_op_t      x n_ops          execution order
+//   weight blobs, each NN_MODEL_ALIGN aligned, referenced by file offset
+// Plain C like nn.h; tools/nn_check loads images on the host.
+
+#define NN_MODEL_MAGIC      0x444D4E4Eu     // "NNMD"
+#define NN_MODEL_VERSION    1
+#define NN_MODEL_ALIGN      16
+#define NN_MODEL_NONE       0xFFFFFFFFu     // blob offset of an absent blob
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;       // must equal NN_MODEL_VERSION
+    uint16_t header_size;   // tables start here; newer packers may append fields
+    uint32_t total_size;    // bytes of the whole image
+    uint32_t crc32;         // CRC-32 (zlib) of bytes header_size..total_size
+    uint16_t n_tensors;
+    uint16_t n_ops;
+    uint16_t input;
+    uint16_t output;
+    char     name[24];      // NUL padded
+} nn_model_hdr_t;
+
+typedef struct {
+    uint16_t h, w, c;
+    int8_t   zero_point;
+    uint8_t  reserved;
+} nn_model_tensor_t;
+
+typedef struct {
+    uint8_t  type;          // nn_op_type_t
+    uint8_t  kh, kw, stride;
+    uint8_t  pad_t, pad_l;
+    int8_t   act_min, act_max;
+    uint16_t input, output;
+    // Convolutions: file offsets of int8 weights, int32 bias (optional),
+    // int32 multipliers and int8 shifts, as nn_op_t describes them
+    uint32_t weights;
+    uint32_t bias;
+    uint32_t multiplier;
+    uint32_t shift;
+} nn_model_op_t;
+
+// Check an image and fill `m`, `tensors` (NN_MAX_TENSORS) and `ops`
+// (max_ops) from it; the ops keep pointers into `data`, which must stay
+// mapped. Format version, sizes, the name, blob bounds and the checksum are
+// checked here, the graph itself by nn_plan(). Returns NULL or what is wrong.
+const char *nn_model_load(const void *data, size_t len, nn_model_t *m,
+                          nn_tensor_t *tensors, nn_op_t *ops, int max_ops);
+
+#endif // NN_MODEL_H
@@ -0,0 +1,33 @@
+#ifndef QUALITY_CTL_H
+#define QUALITY_CTL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- Automatic JPEG quality / frame size ---
+// Once per QCTL_PERIOD_MS the controller compares the sensor stream's
+// bitrate, the mean capture-to-sent latency and the share of frames skipped
+// for congestion with the QCTL_* targets in common.h. Over budget it raises
+// the JPEG quality number (smaller frames), then steps the frame size down.
+// Under budget it does the reverse, one step at a time. A dead band of
+// QCTL_HYSTERESIS_PCT around each target, and a condition having to last
+// several periods before a step, keep it from oscillating.
+
+// Start the controller task (QCTL_ENABLED only)
+void quality_ctl_init(void);
+
+// stream_task: one sensor frame of `bytes` was published
+void quality_ctl_frame(size_t bytes);
+
+// stream engine: a frame reached a client's socket `latency_us` after capture,
+// not counting time the shaper held it back on purpose
+void quality_ctl_sent(int64_t latency_us);
+
+// stream_task: a frame due to a client by its frame rate was replaced
+// because the client's link had not taken the previous one yet
+void quality_ctl_skipped(void);
+
+// {"quality":..,"frame_size":"VGA","kbps":..,"latency_ms":..,"congested_pct":..}
+int quality_ctl_json(char *buf, size_t len);
+
+#endif // QUALITY_CTL_H
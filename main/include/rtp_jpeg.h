@@ -0,0 +1,55 @@
+#ifndef RTP_JPEG_H
+#define RTP_JPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "esp_err.h"
+
+// RTP payload format for JPEG (RFC 2435). Frames from the sensor are sent as
+// they are: the scan data and quantization tables are referenced in place,
+// nothing is decoded or re-encoded. tools/rtp_check runs this packetizer on
+// the host against fixture JPEGs and ffprobe.
+
+#define RTP_PT_JPEG             26      // static payload type
+#define RTP_JPEG_CLOCK_HZ       90000
+#define RTP_JPEG_MAX_PAYLOAD    1400    // RTP payload per packet, fits a 1500 byte MTU
+#define RTP_JPEG_MAX_IOV        4       // headers, two quant tables, scan slice
+
+// What RFC 2435 needs from a baseline JPEG
+typedef struct {
+    uint8_t  type;          // 0 = 4:2:2, 1 = 4:2:0; +64 when restart markers are used
+    uint8_t  width8;        // width / 8
+    uint8_t  height8;       // height / 8
+    uint16_t dri;           // restart interval, 0 = none
+    const uint8_t *qt[2];   // 8-bit luma and chroma tables (zigzag order), in place
+    int      nqt;
+    const uint8_t *scan;    // entropy-coded data after SOS, without EOI
+    size_t   scan_len;
+} rtp_jpeg_info_t;
+
+// Per-stream RTP state
+typedef struct {
+    uint16_t seq;
+    uint32_t ssrc;
+} rtp_stream_t;
+
+// Called once per packet. `len` is the sum of the iov lengths.
+typedef esp_err_t (*rtp_send_fn)(void *ctx, const struct iovec *iov, int iovcnt, size_t len);
+
+// Walk the JPEG markers and fill `info`. Returns ESP_ERR_NOT_SUPPORTED for
+// frames RFC 2435 cannot carry (progressive, grayscale, 16-bit tables, odd sampling).
+esp_err_t rtp_jpeg_parse(const uint8_t *jpg, size_t len, rtp_jpeg_info_t *info);
+
+// Fragment one frame into RTP packets and hand each to `send`. The marker bit
+// is set on the last packet; a send error stops the frame.
+esp_err_t rtp_jpeg_send_frame(rtp_stream_t *rs, const rtp_jpeg_info_t *info, uint32_t ts,
+                              rtp_send_fn send, void *ctx);
+
+// 90 kHz RTP timestamp for an esp_timer microsecond time
+static inline uint32_t rtp_jpeg_timestamp(int64_t us)
+{
+    return (uint32_t)(us * (RTP_JPEG_CLOCK_HZ / 1000) / 1000);
+}
+
+#endif // RTP_JPEG_H
@@ -0,0 +1,16 @@
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include "esp_err.h"
+#include "frame_ref.h"
+
+// RTSP server for rtsp://<ip>/ (RTSP_PORT). One track, RTP/JPEG (RFC 2435),
+// sent over UDP unicast or interleaved on the RTSP connection.
+// Call after stream_init(), which registers the eventfd VFS.
+esp_err_t rtsp_server_start(void);
+
+// Queue a published frame for every playing session (takes its own ref).
+// Costs nothing while no session is playing.
+void rtsp_publish(frame_ref_t *ref);
+
+#endif // RTSP_SERVER_H
@@ -0,0 +1,23 @@
+#ifndef SOCK_IO_H
+#define SOCK_IO_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include "esp_err.h"
+
+// Write every byte described by iov with as few writev() calls as possible.
+// Partial writes advance the vector in place; EAGAIN/EWOULDBLOCK waits for
+// the socket to become writable again, up to timeout_ms in total.
+// Returns ESP_OK, ESP_ERR_TIMEOUT, or ESP_FAIL on a socket error.
+esp_err_t sock_writev_all(int fd, struct iovec *iov, int iovcnt, int timeout_ms);
+
+// Skip `n` already written bytes; returns the index of the first unfinished entry.
+int sock_iov_advance(struct iovec *iov, int iovcnt, size_t n);
+
+// Describe at most the first `max` bytes of iov in `out` (room for iovcnt
+// entries); returns the number of entries used.
+int sock_iov_clamp(const struct iovec *iov, int iovcnt, size_t max, struct iovec *out);
+
+size_t sock_iov_len(const struct iovec *iov, int iovcnt);
+
+#endif // SOCK_IO_H
@@ -0,0 +1,69 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "common.h"
+
+// Start the stream engine task. Call once before start_webserver().
+void stream_init(void);
+
+// --- /ws/stream wire format ---
+// Every frame is one binary WebSocket message: this header followed by the
+// JPEG. All fields little-endian.
+//
+// Upstream text messages from the viewer:
+//   "ack <seq>"  frame <seq> and those sent before it were displayed; once a
+//                viewer acks, at most WS_ACK_WINDOW sent frames stay unacked
+//   "fps <n>"    cap this viewer at n frames per second (1..STREAM_MAX_FPS)
+typedef struct __attribute__((packed)) {
+    uint32_t seq;           // frame_ref_t::seq
+    uint32_t size;          // JPEG bytes following the header
+    int64_t  capture_us;    // capture time, esp_timer microseconds
+} ws_frame_hdr_t;
+
+// Per-client options from the request query
+typedef struct {
+    uint32_t fps;       // 1..STREAM_MAX_FPS, decimates the shared capture
+    uint8_t  scale;     // 1 = sensor JPEG, 2 or 4 = downscaled re-encode (transcode.h)
+    uint8_t  quality;   // re-encode quality 1..100, used when scale > 1
+} stream_opts_t;
+
+// Parse "fps=N&scale=S&q=Q". Missing values get the defaults, fps and q are
+// clamped, a scale other than 2 or 4 means the sensor JPEG.
+void stream_parse_opts(const char *query, stream_opts_t *opts);
+
+// Hand an incoming /stream or /ws/stream request over to a free client slot.
+// The request is detached from the httpd worker and its socket is owned by the
+// stream engine, so the handler returns right away. For STREAM_WS the
+// WebSocket handshake must already have been answered by httpd.
+// Returns ESP_ERR_NO_MEM when every slot (or every transcode profile) is busy.
+esp_err_t stream_client_attach(httpd_req_t *req, stream_kind_t kind, const stream_opts_t *opts);
+
+// Also accept viewers on the old dedicated stream port (http://<ip>:<port>/stream).
+// The stream engine serves that socket directly; only /stream is answered there.
+esp_err_t stream_listen_legacy(uint16_t port);
+
+// Fan a published frame out to every connected client of `profile` (takes its
+// own refs). Profile 0 is the sensor JPEG, others come from the transcoder.
+void stream_publish(frame_ref_t *ref, int profile);
+
+// Bandwidth shaper settings, see SHAPER_* in common.h. Rates in bytes per
+// second, 0 = no cap.
+typedef struct {
+    bool enabled;
+    uint32_t client_Bps;
+    uint32_t total_Bps;
+} stream_shaper_t;
+
+void stream_shaper_get(stream_shaper_t *cfg);
+void stream_shaper_set(const stream_shaper_t *cfg);
+
+// Newest sensor frame handed to stream_publish(), or NULL before the first one.
+// The caller owns the returned reference.
+frame_ref_t *stream_latest(void);
+
+// [{"id":0,"proto":"ws","fps":..,"scale":..,"rate_kbps":..,"send_ms":..,"congested":..}, ...] for connected clients
+int stream_clients_json(char *buf, size_t len);
+
+#endif // STREAM_H
@@ -0,0 +1,11 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <stddef.h>
+
+// Write per-task CPU usage since the previous call as JSON into buf.
+// Needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS; otherwise reports an error object.
+// Returns the number of characters written.
+int task_stats_json(char *buf, size_t len);
+
+#endif // TASK_STATS_H
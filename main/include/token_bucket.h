@@ -0,0 +1,31 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte token bucket: refills at rate_Bps up to `burst` bytes.
+// Credit is kept in byte-microseconds so slow rates lose nothing to rounding.
+// Not thread safe; each bucket belongs to one task.
+typedef struct {
+    uint32_t rate_Bps;      // 0 = unlimited
+    uint32_t burst;         // largest amount that can be sent at once
+    int64_t  credit;        // bytes * 1e6
+    int64_t  last_us;
+} token_bucket_t;
+
+// Starts full
+void tb_init(token_bucket_t *tb, uint32_t rate_Bps, uint32_t burst, int64_t now_us);
+
+// Change the rate; credit earned so far is kept at the old rate
+void tb_set_rate(token_bucket_t *tb, uint32_t rate_Bps, int64_t now_us);
+
+// Refill and return the whole bytes that may be sent now (SIZE_MAX if unlimited)
+size_t tb_available(token_bucket_t *tb, int64_t now_us);
+
+void tb_consume(token_bucket_t *tb, size_t bytes);
+
+// Microseconds until `bytes` (<= burst) are available, as of the last refill
+int64_t tb_wait_us(const token_bucket_t *tb, size_t bytes);
+
+#endif // TOKEN_BUCKET_H
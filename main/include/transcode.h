@@ -0,0 +1,29 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "frame_ref.h"
+
+// Downscaled re-encodes of the sensor stream for slow links. A profile is one
+// (scale, quality) pair; every client asking for the same pair shares the
+// frames produced for it, so a profile costs one decode/encode per frame no
+// matter how many viewers use it. Profile 0 is the sensor JPEG itself.
+#define TRANSCODE_MAX_PROFILES      2
+#define TRANSCODE_DEFAULT_QUALITY   60      // fmt2jpg quality, 1..100
+
+// Start the transcode task
+void transcode_init(void);
+
+// Join the profile for `scale` (2 or 4) and `quality`, creating it if needed.
+// Returns its id (1..TRANSCODE_MAX_PROFILES) or -1 when every profile is in
+// use by other settings.
+int transcode_profile_acquire(uint8_t scale, uint8_t quality);
+void transcode_profile_release(int id);
+
+// Hand the newest sensor frame to the transcoder (takes its own ref).
+// No-op while no profile has clients.
+void transcode_submit(frame_ref_t *ref);
+
+#endif // TRANSCODE_H
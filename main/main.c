@@ -4,6 +4,14 @@
 #include "camera.h"
 #include "servo.h"
 #include "webserver.h"
+#include "stream.h"
+#include "rtsp_server.h"
+#include "mcast_stream.h"
+#include "transcode.h"
+#include "frame_poll.h"
+#include "quality_ctl.h"
+#include "face_task.h"
+#include "model_store.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "nvs_flash.h"
@@ -17,7 +25,7 @@
 
 void app_main(void)
 {
-    ESP_LOGI(TAG, "ESP32-CAM Streaming (double-buffer version)");
+    ESP_LOGI(TAG, "ESP32-CAM Streaming (frame ring version)");
     ESP_LOGI(TAG, "Free heap: %d bytes", esp_get_free_heap_size());
 
     // init NVS
@@ -54,9 +62,41 @@ void app_main(void)
     // --- Servo PWM ---
     init_servo_pwm();
 
+    // --- MJPEG stream engine ---
+    stream_init();
+
+    // --- Transcoder for ?scale= viewers ---
+    transcode_init();
+
+    // --- /frame long-poll ---
+    frame_poll_init();
+
     // --- Start HTTP server ---
     start_webserver();  
 
+    // --- RTSP server ---
+    rtsp_server_start();
+
+#if MCAST_ENABLED
+    // --- Multicast stream ---
+    mcast_stream_start();
+#endif
+
+#if QCTL_ENABLED
+    // --- Auto JPEG quality / frame size ---
+    quality_ctl_init();
+#endif
+
+#if NN_MODEL_ENABLED
+    // --- Model weights from flash ---
+    model_store_init();
+#endif
+
+#if FACE_DETECT_ENABLED
+    // --- Face detection ---
+    face_task_init();
+#endif
+
     // --- Tasks ---
     xTaskCreate(camera_capture_task, "camera_capture_task", 8192, NULL, 5, NULL);
     xTaskCreate(stream_task,         "stream_task",         8192, NULL, 4, NULL);
@@ -1,11 +1,16 @@
 #include "camera.h"
 #include "esp_camera.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "latency_hist.h"
 #include "driver/gpio.h"
 #include "common.h" 
 
 static const char *TAG = "CAMERA";
 
+_Static_assert(CAMERA_FB_COUNT >= CAMERA_FB_WORST_CASE,
+               "CAMERA_FB_COUNT does not cover every frame holder, see common.h");
+
 // === Default pins for AI Thinker ESP32-CAM ===
 static camera_pins_t default_pins = {
     .pin_pwdn     = 32,
@@ -52,14 +57,20 @@ esp_err_t camera_init(const camera_pins_t *pins)
         .ledc_timer     = LEDC_TIMER_0,
         .ledc_channel   = LEDC_CHANNEL_0,
         .pixel_format   = PIXFORMAT_JPEG,
-        .frame_size     = FRAMESIZE_VGA,
+        .frame_size     = CAMERA_FRAME_SIZE,
         .fb_location = CAMERA_FB_IN_PSRAM,
-        .jpeg_quality   = 12,
-        .fb_count       = 2,
+        .jpeg_quality   = CAMERA_JPEG_QUALITY,
+        .fb_count       = CAMERA_FB_COUNT,
         .grab_mode      = CAMERA_GRAB_LATEST
     };
 
-    esp_err_t err = esp_camera_init(&config);
+    esp_err_t err = frame_ring_init(&frame_ring, FRAME_RING_DEPTH, FRAME_RING_OVERWRITE_OLDEST);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Frame ring init failed: 0x%x", err);
+        return err;
+    }
+
+    err = esp_camera_init(&config);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera init failed: 0x%x", err);
         return err;
@@ -78,28 +89,37 @@ void camera_capture_task(void *pvParameters)
     gpio_set_level(cfg->flash_gpio, 0);
 
     while (1) {
-        if (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) {
-            camera_fb_t* fb = esp_camera_fb_get();
-            if (!fb) {
-                vTaskDelay(pdMS_TO_TICKS(10));
-                continue;
-            }
+        // Block until Wi-Fi is up instead of spinning on the event group
+        xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT,
+                            pdFALSE, pdTRUE, portMAX_DELAY);
 
-          volatile uint8_t idx = frame_buffer.write_index;
+        // Blocks inside the driver until the next frame is complete
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
 
-        if (frame_buffer.ready[idx] && frame_buffer.fb[idx]) {
-            esp_camera_fb_return(frame_buffer.fb[idx]);
-            }
+        // Frame wrapper carries the sequence number and the reference count
+        frame_ref_t *ref = frame_ref_from_fb(fb);
+        if (!ref) {
+            drop_count(DROP_NO_WRAPPER, 1);
+            continue;
+        }
 
-            frame_buffer.fb[idx] = fb;
-            frame_buffer.ready[idx] = true;
+        ref->publish_us = esp_timer_get_time();
+        latency_record(LAT_CAPTURE_TO_PUBLISH, ref->publish_us - ref->capture_us);
 
-            __asm__ volatile ("" ::: "memory");
+        // Ring is OVERWRITE_OLDEST, so this never blocks the capture loop
+        uint32_t overwritten = atomic_load(&frame_ring.overwritten);
+        frame_ring_push(&frame_ring, ref, 0);
+        drop_count(DROP_RING_OVERWRITE, atomic_load(&frame_ring.overwritten) - overwritten);
 
-            frame_buffer.write_index = idx ^ 1;
+        total_frames_captured++;
 
-            total_frames_captured++;
+        // Wake the consumer; it sleeps until this notification arrives
+        if (stream_task_handle) {
+            xTaskNotifyGive(stream_task_handle);
         }
-        taskYIELD();
     }
 }
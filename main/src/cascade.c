@@ -0,0 +1,352 @@
+#include "cascade.h"
+#include <string.h>
+
+_Static_assert(sizeof(cascade_file_hdr_t) == 20, "file layout");
+_Static_assert(sizeof(cascade_stage_t) == 8, "file layout");
+_Static_assert(sizeof(cascade_haar_node_t) == 16, "file layout");
+_Static_assert(sizeof(cascade_lbp_node_t) == 44, "file layout");
+_Static_assert(sizeof(cascade_haar_feature_t) == 24, "file layout");
+_Static_assert(sizeof(cascade_lbp_feature_t) == 4, "file layout");
+
+// Hits closer than this share of their size are the same object (OpenCV's eps)
+#define GROUP_EPS_Q8    51          // 0.2
+
+static bool feature_fits(const cascade_t *c, int i)
+{
+    if (c->type == CASCADE_LBP) {
+        const cascade_lbp_feature_t *f = &((const cascade_lbp_feature_t *)c->features)[i];
+        return f->w && f->h && f->x + 3 * f->w <= c->win_w && f->y + 3 * f->h <= c->win_h;
+    }
+
+    // The weighted sum is taken in int32, so bound it for all-white pixels
+    const cascade_haar_feature_t *f = &((const cascade_haar_feature_t *)c->features)[i];
+    int64_t span = 0;
+    for (int r = 0; r < CASCADE_MAX_RECTS; r++) {
+        const cascade_rect_t *rc = &f->rect[r];
+        if (rc->weight && (rc->x + rc->w > c->win_w || rc->y + rc->h > c->win_h)) {
+            return false;
+        }
+        span += (int64_t)(rc->weight < 0 ? -rc->weight : rc->weight) * rc->w * rc->h * 255;
+    }
+    return f->rect[0].weight != 0 && span <= INT32_MAX;
+}
+
+bool cascade_load(cascade_t *c, const void *data, size_t len)
+{
+    const cascade_file_hdr_t *hdr = data;
+    if (((uintptr_t)data & 3) || len < sizeof(*hdr) ||
+        hdr->magic != CASCADE_MAGIC || hdr->version != CASCADE_VERSION ||
+        (hdr->type != CASCADE_HAAR && hdr->type != CASCADE_LBP) ||
+        hdr->n_stages == 0 || hdr->n_stages > CASCADE_MAX_STAGES ||
+        hdr->win_w < 3 || hdr->win_h < 3 || hdr->win_w > 255 || hdr->win_h > 255) {
+        return false;
+    }
+
+    size_t node_size = hdr->type == CASCADE_LBP ? sizeof(cascade_lbp_node_t)
+                                                : sizeof(cascade_haar_node_t);
+    size_t feature_size = hdr->type == CASCADE_LBP ? sizeof(cascade_lbp_feature_t)
+                                                   : sizeof(cascade_haar_feature_t);
+    size_t need = sizeof(*hdr) + hdr->n_stages * sizeof(cascade_stage_t) +
+                  (size_t)hdr->n_nodes * node_size + (size_t)hdr->n_features * feature_size;
+    if (len < need) return false;
+
+    const uint8_t *p = (const uint8_t *)data + sizeof(*hdr);
+    c->type = hdr->type;
+    c->win_w = hdr->win_w;
+    c->win_h = hdr->win_h;
+    c->n_stages = hdr->n_stages;
+    c->n_features = hdr->n_features;
+    c->n_nodes = hdr->n_nodes;
+    c->stages = (const cascade_stage_t *)p;
+    p += hdr->n_stages * sizeof(cascade_stage_t);
+    c->nodes = p;
+    p += (size_t)hdr->n_nodes * node_size;
+    c->features = p;
+
+    uint32_t nodes = 0;
+    for (int s = 0; s < c->n_stages; s++) {
+        nodes += c->stages[s].n_nodes;
+    }
+    if (nodes != c->n_nodes) return false;
+
+    for (uint32_t i = 0; i < c->n_nodes; i++) {
+        uint16_t f = c->type == CASCADE_LBP ? ((const cascade_lbp_node_t *)c->nodes)[i].feature
+                                            : ((const cascade_haar_node_t *)c->nodes)[i].feature;
+        if (f >= c->n_features) return false;
+    }
+    for (int i = 0; i < c->n_features; i++) {
+        if (!feature_fits(c, i)) return false;
+    }
+    return true;
+}
+
+// --- Scratch layout ---
+// integral and squared integral of the largest level, (w+1) x (h+1) each,
+// then the raw hits and their group labels
+static size_t integral_len(int width, int height)
+{
+    return (size_t)(width + 1) * (height + 1) * sizeof(uint32_t);
+}
+
+size_t cascade_scratch_size(const cascade_t *c, int width, int height)
+{
+    size_t ii = integral_len(width, height);
+    return ii * (c->type == CASCADE_HAAR ? 2 : 1) +
+           CASCADE_MAX_HITS * (sizeof(cascade_hit_t) + sizeof(uint16_t));
+}
+
+// Resample one pyramid level from `luma` (nearest neighbour) and build its
+// integral images in the same pass. Sums are kept modulo 2^32: differences
+// of four corners stay exact as long as one window's sums fit, so there is
+// no limit on the image size.
+static void build_integrals(const uint8_t *luma, int width, int lw, int lh, int scale_q8,
+                            uint32_t *ii, uint32_t *sq)
+{
+    const int stride = lw + 1;
+    memset(ii, 0, stride * sizeof(uint32_t));
+    if (sq) memset(sq, 0, stride * sizeof(uint32_t));
+
+    for (int y = 0; y < lh; y++) {
+        const uint8_t *src = luma + (size_t)((y * scale_q8) >> 8) * width;
+        uint32_t *row = ii + (size_t)(y + 1) * stride;
+        const uint32_t *above = row - stride;
+        uint32_t sum = 0;
+        row[0] = 0;
+
+        if (sq) {
+            uint32_t *sq_row = sq + (size_t)(y + 1) * stride;
+            const uint32_t *sq_above = sq_row - stride;
+            uint32_t sqsum = 0;
+            sq_row[0] = 0;
+            for (int x = 0; x < lw; x++) {
+                uint32_t v = src[(x * scale_q8) >> 8];
+                sum += v;
+                sqsum += v * v;
+                row[x + 1] = above[x + 1] + sum;
+                sq_row[x + 1] = sq_above[x + 1] + sqsum;
+            }
+        } else {
+            for (int x = 0; x < lw; x++) {
+                sum += src[(x * scale_q8) >> 8];
+                row[x + 1] = above[x + 1] + sum;
+            }
+        }
+    }
+}
+
+static inline uint32_t rect_sum(const uint32_t *p, int stride, int x, int y, int w, int h)
+{
+    const uint32_t *a = p + y * stride + x;
+    const uint32_t *b = a + h * stride;
+    return a[0] - a[w] - b[0] + b[w];
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+// Stage index the window failed at, or n_stages when it passed them all
+static int eval_haar(const cascade_t *c, const uint32_t *ii, const uint32_t *sq, int stride)
+{
+    const int nw = c->win_w - 2, nh = c->win_h - 2;
+    int64_t area = (int64_t)nw * nh;
+    int64_t s = rect_sum(ii, stride, 1, 1, nw, nh);
+    int64_t s2 = rect_sum(sq, stride, 1, 1, nw, nh);
+    int64_t var = area * s2 - s * s;
+    int64_t norm = var > 0 ? isqrt64((uint64_t)var) : 1;
+
+    const cascade_haar_node_t *node = c->nodes;
+    const cascade_haar_feature_t *features = c->features;
+
+    for (int st = 0; st < c->n_stages; st++) {
+        int32_t sum = 0;
+        for (int n = c->stages[st].n_nodes; n > 0; n--, node++) {
+            const cascade_rect_t *r = features[node->feature].rect;
+            int32_t v = r[0].weight * (int32_t)rect_sum(ii, stride, r[0].x, r[0].y, r[0].w, r[0].h) +
+                        r[1].weight * (int32_t)rect_sum(ii, stride, r[1].x, r[1].y, r[1].w, r[1].h);
+            if (r[2].weight) {
+                v += r[2].weight * (int32_t)rect_sum(ii, stride, r[2].x, r[2].y, r[2].w, r[2].h);
+            }
+            // v / norm < threshold, without the division
+            sum += ((int64_t)v << CASCADE_THR_SHIFT) < (int64_t)node->threshold * norm
+                   ? node->left : node->right;
+        }
+        if (sum < c->stages[st].threshold) return st;
+    }
+    return c->n_stages;
+}
+
+static inline int lbp_code(const uint32_t *ii, int stride, const cascade_lbp_feature_t *f)
+{
+    // Corners of the 3x3 block grid, row by row
+    uint32_t p[16];
+    for (int r = 0; r < 4; r++) {
+        const uint32_t *row = ii + (f->y + r * f->h) * stride + f->x;
+        p[r * 4 + 0] = row[0];
+        p[r * 4 + 1] = row[f->w];
+        p[r * 4 + 2] = row[2 * f->w];
+        p[r * 4 + 3] = row[3 * f->w];
+    }
+#define BLOCK(i)    (p[(i) / 3 * 4 + (i) % 3] - p[(i) / 3 * 4 + (i) % 3 + 1] - \
+                     p[(i) / 3 * 4 + (i) % 3 + 4] + p[(i) / 3 * 4 + (i) % 3 + 5])
+    uint32_t cval = BLOCK(4);
+    // Clockwise from the top left block, as OpenCV's LBPEvaluator
+    return (BLOCK(0) >= cval) << 7 | (BLOCK(1) >= cval) << 6 | (BLOCK(2) >= cval) << 5 |
+           (BLOCK(5) >= cval) << 4 | (BLOCK(8) >= cval) << 3 | (BLOCK(7) >= cval) << 2 |
+           (BLOCK(6) >= cval) << 1 | (BLOCK(3) >= cval);
+#undef BLOCK
+}
+
+static int eval_lbp(const cascade_t *c, const uint32_t *ii, int stride)
+{
+    const cascade_lbp_node_t *node = c->nodes;
+    const cascade_lbp_feature_t *features = c->features;
+
+    for (int st = 0; st < c->n_stages; st++) {
+        int32_t sum = 0;
+        for (int n = c->stages[st].n_nodes; n > 0; n--, node++) {
+            int code = lbp_code(ii, stride, &features[node->feature]);
+            sum += node->subset[code >> 5] & (1u << (code & 31)) ? node->left : node->right;
+        }
+        if (sum < c->stages[st].threshold) return st;
+    }
+    return c->n_stages;
+}
+
+static inline int iabs(int v)
+{
+    return v < 0 ? -v : v;
+}
+
+static bool similar(const cascade_hit_t *a, const cascade_hit_t *b)
+{
+    int min_w = a->w < b->w ? a->w : b->w;
+    int min_h = a->h < b->h ? a->h : b->h;
+    int delta = (GROUP_EPS_Q8 * (min_w + min_h)) >> 9;     // eps * (w + h) / 2
+    return iabs(a->x - b->x) <= delta && iabs(a->y - b->y) <= delta &&
+           iabs(a->x + a->w - b->x - b->w) <= delta &&
+           iabs(a->y + a->h - b->y - b->h) <= delta;
+}
+
+static int find_root(uint16_t *label, int i)
+{
+    while (label[i] != i) {
+        label[i] = label[label[i]];
+        i = label[i];
+    }
+    return i;
+}
+
+// Merge similar raw hits (union-find), average each group, keep those with
+// more than min_neighbors members (OpenCV's groupRectangles)
+static int group_hits(cascade_hit_t *hits, uint16_t *label, int n, int min_neighbors,
+                      cascade_hit_t *out, int max_out)
+{
+    for (int i = 0; i < n; i++) label[i] = i;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            if (similar(&hits[i], &hits[j])) {
+                int a = find_root(label, i), b = find_root(label, j);
+                if (a != b) label[b] = a;
+            }
+        }
+    }
+
+    int count = 0;
+    for (int root = 0; root < n; root++) {
+        if (find_root(label, root) != root) continue;
+
+        int32_t x = 0, y = 0, w = 0, h = 0;
+        int members = 0;
+        for (int i = root; i < n; i++) {
+            if (find_root(label, i) != root) continue;
+            x += hits[i].x; y += hits[i].y; w += hits[i].w; h += hits[i].h;
+            members++;
+        }
+        if (members <= min_neighbors) continue;
+
+        cascade_hit_t g = {
+            .x = (x + members / 2) / members, .y = (y + members / 2) / members,
+            .w = (w + members / 2) / members, .h = (h + members / 2) / members,
+            .neighbors = members,
+        };
+
+        // Insertion by neighbors, descending
+        int pos = count;
+        while (pos > 0 && out[pos - 1].neighbors < g.neighbors) pos--;
+        if (pos >= max_out) continue;
+        int last = count < max_out ? count : max_out - 1;
+        memmove(&out[pos + 1], &out[pos], (last - pos) * sizeof(*out));
+        out[pos] = g;
+        if (count < max_out) count++;
+    }
+    return count;
+}
+
+int cascade_detect(const cascade_t *c, const cascade_params_t *p,
+                   const uint8_t *luma, int width, int height, void *scratch,
+                   cascade_hit_t *out, int max_out, cascade_stats_t *stats)
+{
+    if (p->stride < 1 || p->scale_step_q8 <= 256 || max_out <= 0) return 0;
+
+    uint8_t *mem = scratch;
+    uint32_t *ii = (uint32_t *)mem;
+    mem += integral_len(width, height);
+    uint32_t *sq = NULL;
+    if (c->type == CASCADE_HAAR) {
+        sq = (uint32_t *)mem;
+        mem += integral_len(width, height);
+    }
+    cascade_hit_t *hits = (cascade_hit_t *)mem;
+    uint16_t *label = (uint16_t *)(hits + CASCADE_MAX_HITS);
+    int n_hits = 0;
+
+    // Level k samples every scale_q8 / 256 source pixels; the window covers
+    // win * scale_q8 / 256 of the image
+    for (uint32_t scale_q8 = 256; ; scale_q8 = (scale_q8 * p->scale_step_q8) >> 8) {
+        int lw = (int)(((uint32_t)width << 8) / scale_q8);
+        int lh = (int)(((uint32_t)height << 8) / scale_q8);
+        if (lw < c->win_w || lh < c->win_h) break;
+
+        build_integrals(luma, width, lw, lh, scale_q8, ii, sq);
+        const int stride = lw + 1;
+
+        for (int y = 0; y + c->win_h <= lh; y += p->stride) {
+            for (int x = 0; x + c->win_w <= lw; x += p->stride) {
+                const uint32_t *wi = ii + y * stride + x;
+                int stage = c->type == CASCADE_HAAR
+                            ? eval_haar(c, wi, sq + y * stride + x, stride)
+                            : eval_lbp(c, wi, stride);
+
+                if (stats) {
+                    stats->windows++;
+                    if (stage < c->n_stages) stats->rejected[stage]++;
+                    else stats->hits++;
+                }
+                if (stage < c->n_stages || n_hits == CASCADE_MAX_HITS) continue;
+
+                hits[n_hits++] = (cascade_hit_t) {
+                    .x = (x * scale_q8) >> 8,
+                    .y = (y * scale_q8) >> 8,
+                    .w = (c->win_w * scale_q8) >> 8,
+                    .h = (c->win_h * scale_q8) >> 8,
+                };
+            }
+        }
+    }
+
+    return group_hits(hits, label, n_hits, p->min_neighbors, out, max_out);
+}
@@ -0,0 +1,67 @@
+#include "drop_stats.h"
+#include "esp_camera.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+static atomic_uint app_drops[DROP_REASON_MAX];
+
+static const char *const reason_names[DROP_REASON_MAX] = {
+    [DROP_RING_OVERWRITE] = "ring_overwrite",
+    [DROP_NO_WRAPPER]     = "no_wrapper",
+    [DROP_RING_STALE]     = "ring_stale",
+    [DROP_BAD_JPEG]       = "bad_jpeg",
+    [DROP_CLIENT_RATE]    = "client_rate",
+    [DROP_CLIENT_CONGESTED] = "client_congested",
+    [DROP_CLIENT_NO_MEM]  = "client_no_mem",
+    [DROP_SEND_FAIL]      = "send_fail",
+    [DROP_TRANSCODE_BUSY] = "transcode_busy",
+};
+
+void drop_count(drop_reason_t reason, uint32_t n)
+{
+    if (reason < DROP_REASON_MAX && n) {
+        atomic_fetch_add_explicit(&app_drops[reason], n, memory_order_relaxed);
+    }
+}
+
+uint32_t drop_get(drop_reason_t reason)
+{
+    return reason < DROP_REASON_MAX ?
+           atomic_load_explicit(&app_drops[reason], memory_order_relaxed) : 0;
+}
+
+uint32_t drop_total(void)
+{
+    camera_drop_stats_t drv;
+    esp_camera_get_drop_stats(&drv);
+
+    uint32_t total = drv.fb_overflow + drv.dma_overflow + drv.no_soi +
+                     drv.no_eoi + drv.event_overflow + drv.fb_replaced;
+    for (int i = 0; i < DROP_REASON_MAX; i++) {
+        if (i == DROP_CLIENT_RATE) continue;    // asked-for decimation, not a loss
+        total += atomic_load_explicit(&app_drops[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+int drop_stats_json(char *buf, size_t len)
+{
+    camera_drop_stats_t drv;
+    esp_camera_get_drop_stats(&drv);
+
+    int off = snprintf(buf, len, "{\"app\":{");
+    for (int i = 0; i < DROP_REASON_MAX && off < (int)len; i++) {
+        off += snprintf(buf + off, len - off, "%s\"%s\":%u", i ? "," : "",
+                        reason_names[i],
+                        atomic_load_explicit(&app_drops[i], memory_order_relaxed));
+    }
+    if (off < (int)len) {
+        off += snprintf(buf + off, len - off,
+            "},\"driver\":{\"fb_overflow\":%lu,\"dma_overflow\":%lu,\"no_soi\":%lu,"
+            "\"no_eoi\":%lu,\"event_overflow\":%lu,\"fb_replaced\":%lu}}",
+            (unsigned long)drv.fb_overflow, (unsigned long)drv.dma_overflow,
+            (unsigned long)drv.no_soi, (unsigned long)drv.no_eoi,
+            (unsigned long)drv.event_overflow, (unsigned long)drv.fb_replaced);
+    }
+    return off;
+}
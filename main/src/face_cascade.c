@@ -0,0 +1,59 @@
+#include "face_detect.h"
+#include "cascade.h"
+
+// --- Cascade face detector ---
+// face_detector_t on top of cascade.c: RGB565 to luma, then the cascade set
+// by face_cascade_set(). Boxes are scored by how many raw hits they merge.
+
+static const cascade_t *cascade;
+static cascade_params_t params;
+static cascade_stats_t *stats;
+
+void face_cascade_set(const cascade_t *c, const cascade_params_t *p, cascade_stats_t *s)
+{
+    cascade = c;
+    params = *p;
+    stats = s;
+}
+
+static size_t cascade_face_scratch_size(int width, int height)
+{
+    if (!cascade) return 0;
+    size_t luma = ((size_t)width * height + 3) & ~(size_t)3;
+    return luma + cascade_scratch_size(cascade, width, height);
+}
+
+static int cascade_face_detect(const uint8_t *rgb565, int width, int height, void *scratch,
+                               face_box_t *boxes, int max_boxes)
+{
+    if (!cascade || max_boxes <= 0) return 0;
+
+    const size_t n = (size_t)width * height;
+    uint8_t *luma = scratch;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *px = rgb565 + 2 * i;
+        uint16_t v = (uint16_t)(px[0] << 8 | px[1]);
+        int r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+        // BT.601 luma straight from the 5/6/5 bit fields
+        luma[i] = (uint8_t)((r * 629 + g * 608 + b * 240) >> 8);
+    }
+
+    cascade_hit_t hits[8];
+    int max = max_boxes < 8 ? max_boxes : 8;
+    int count = cascade_detect(cascade, &params, luma, width, height,
+                               luma + ((n + 3) & ~(size_t)3), hits, max, stats);
+
+    for (int i = 0; i < count; i++) {
+        boxes[i] = (face_box_t) {
+            .x = hits[i].x, .y = hits[i].y, .w = hits[i].w, .h = hits[i].h,
+            .score = hits[i].neighbors * 16 > 255 ? 255 : hits[i].neighbors * 16,
+        };
+    }
+    return count;
+}
+
+const face_detector_t face_detector_cascade = {
+    .name = "cascade",
+    .scratch_size = cascade_face_scratch_size,
+    .detect = cascade_face_detect,
+};
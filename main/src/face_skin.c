@@ -0,0 +1,130 @@
+#include "face_detect.h"
+#include <string.h>
+
+// --- Skin-colour blob detector ---
+// Every pixel is classified in YCbCr with integer BT.601 coefficients, skin
+// pixels are grouped into 4-connected blobs by flood fill, and blobs whose
+// size, aspect and fill look like a face are kept. Fixed point throughout.
+
+// Chroma box for skin under mixed lighting (Chai & Ngan)
+#define SKIN_CB_MIN     77
+#define SKIN_CB_MAX     127
+#define SKIN_CR_MIN     133
+#define SKIN_CR_MAX     173
+#define SKIN_Y_MIN      40          // shadows have unreliable chroma
+
+#define BLOB_MIN_SIDE   6           // pixels at the decoded scale
+#define BLOB_ASPECT_MIN 230         // height / width, x256 (0.9)
+#define BLOB_ASPECT_MAX 563         // (2.2)
+#define BLOB_FILL_MIN   115         // area / bounding box, x256 (0.45; an ellipse is 0.79)
+
+#define MASK_SKIN       1
+#define MASK_SEEN       2
+
+#define MAX_PIXELS      65535       // queue entries are uint16_t
+
+static inline int is_skin(const uint8_t *px)
+{
+    uint16_t v = (uint16_t)(px[0] << 8 | px[1]);
+    int r = (v >> 11) & 0x1F;
+    int g = (v >> 5) & 0x3F;
+    int b = v & 0x1F;
+    r = r << 3 | r >> 2;
+    g = g << 2 | g >> 4;
+    b = b << 3 | b >> 2;
+
+    int y  = (77 * r + 150 * g + 29 * b) >> 8;
+    int cb = 128 + ((-43 * r - 85 * g + 128 * b) >> 8);
+    int cr = 128 + ((128 * r - 107 * g - 21 * b) >> 8);
+
+    return y >= SKIN_Y_MIN &&
+           cb >= SKIN_CB_MIN && cb <= SKIN_CB_MAX &&
+           cr >= SKIN_CR_MIN && cr <= SKIN_CR_MAX;
+}
+
+// Mask bytes, padded so the queue after them is aligned
+static inline size_t mask_len(size_t n)
+{
+    return (n + 3) & ~(size_t)3;
+}
+
+static size_t skin_scratch_size(int width, int height)
+{
+    size_t n = (size_t)width * height;
+    return mask_len(n) + n * sizeof(uint16_t);  // mask, flood fill queue
+}
+
+// Keep the `max` largest boxes, biggest first
+static int insert_box(face_box_t *boxes, int count, int max, const face_box_t *box)
+{
+    int area = box->w * box->h;
+    int pos = count;
+    while (pos > 0 && boxes[pos - 1].w * boxes[pos - 1].h < area) pos--;
+    if (pos >= max) return count;
+
+    int last = count < max ? count : max - 1;
+    memmove(&boxes[pos + 1], &boxes[pos], (last - pos) * sizeof(*boxes));
+    boxes[pos] = *box;
+    return count < max ? count + 1 : count;
+}
+
+static int skin_detect(const uint8_t *rgb565, int width, int height, void *scratch,
+                       face_box_t *boxes, int max_boxes)
+{
+    const int n = width * height;
+    if (n <= 0 || n > MAX_PIXELS || max_boxes <= 0) return 0;
+
+    uint8_t *mask = scratch;
+    uint16_t *queue = (uint16_t *)(mask + mask_len(n));
+
+    for (int i = 0; i < n; i++) {
+        mask[i] = is_skin(rgb565 + 2 * i) ? MASK_SKIN : 0;
+    }
+
+    int count = 0;
+    for (int start = 0; start < n; start++) {
+        if (mask[start] != MASK_SKIN) continue;
+
+        int head = 0, tail = 0;
+        int min_x = width, max_x = 0, min_y = height, max_y = 0;
+        queue[tail++] = start;
+        mask[start] = MASK_SEEN;
+
+        while (head < tail) {
+            int p = queue[head++];
+            int x = p % width;
+            int y = p / width;
+            if (x < min_x) min_x = x;
+            if (x > max_x) max_x = x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
+
+            if (x > 0 && mask[p - 1] == MASK_SKIN)          { mask[p - 1] = MASK_SEEN; queue[tail++] = p - 1; }
+            if (x < width - 1 && mask[p + 1] == MASK_SKIN)  { mask[p + 1] = MASK_SEEN; queue[tail++] = p + 1; }
+            if (y > 0 && mask[p - width] == MASK_SKIN)      { mask[p - width] = MASK_SEEN; queue[tail++] = p - width; }
+            if (y < height - 1 && mask[p + width] == MASK_SKIN) { mask[p + width] = MASK_SEEN; queue[tail++] = p + width; }
+        }
+
+        int w = max_x - min_x + 1;
+        int h = max_y - min_y + 1;
+        int area = tail;    // every pixel of the blob went through the queue once
+        if (w < BLOB_MIN_SIDE || h < BLOB_MIN_SIDE) continue;
+
+        int aspect = h * 256 / w;
+        int fill = area * 256 / (w * h);
+        if (aspect < BLOB_ASPECT_MIN || aspect > BLOB_ASPECT_MAX || fill < BLOB_FILL_MIN) continue;
+
+        face_box_t box = {
+            .x = min_x, .y = min_y, .w = w, .h = h,
+            .score = fill > 255 ? 255 : fill,
+        };
+        count = insert_box(boxes, count, max_boxes, &box);
+    }
+    return count;
+}
+
+const face_detector_t face_detector_skin = {
+    .name = "skin",
+    .scratch_size = skin_scratch_size,
+    .detect = skin_detect,
+};
@@ -0,0 +1,261 @@
+#include "face_task.h"
+#include "common.h"
+#include "latency_hist.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "jpeg_decoder.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "FACE";
+
+#define FACE_STACK_SIZE     4096
+#define FACE_PRIORITY       2       // below streaming: detection takes what is left
+
+static const face_detector_t *detector = &face_detector_skin;
+
+// Loaded from FACE_CASCADE_PATH at init; kept for the life of the task
+static cascade_t cascade;
+static cascade_stats_t cascade_stats;   // written by the task only
+
+static TaskHandle_t face_task_handle = NULL;
+static portMUX_TYPE face_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_ref_t *pending = NULL;     // guarded by face_lock
+static face_result_t result;            // guarded by face_lock
+static uint32_t frames_skipped;         // guarded by face_lock, replaced before the task got to them
+
+// Task-owned buffers, grown when the frame size grows
+static uint8_t *rgb_buf = NULL;
+static size_t rgb_cap = 0;
+static void *scratch = NULL;
+static size_t scratch_cap = 0;
+
+// Throughput, written by the task only
+static uint32_t frames_done;
+static uint32_t rate_x10;               // detections per second x10, last window
+static uint32_t decode_us;              // smoothed
+static uint32_t detect_us;
+
+static inline uint32_t ewma(uint32_t avg, uint32_t sample)
+{
+    return avg ? avg - avg / 4 + sample / 4 : sample;
+}
+
+void face_submit(frame_ref_t *ref)
+{
+    if (!face_task_handle) return;
+
+    portENTER_CRITICAL(&face_lock);
+    frame_ref_t *old = pending;
+    pending = frame_ref_get(ref);
+    if (old) frames_skipped++;
+    portEXIT_CRITICAL(&face_lock);
+
+    frame_ref_put(old);
+    xTaskNotifyGive(face_task_handle);
+}
+
+static bool grow(void **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap) return true;
+    heap_caps_free(*buf);
+    *buf = heap_caps_malloc(need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    *cap = *buf ? need : 0;
+    return *buf != NULL;
+}
+
+// Decode `src` at 1/FACE_DECODE_SCALE into rgb_buf (big-endian RGB565)
+static esp_err_t decode_scaled(const frame_ref_t *src, uint16_t *width, uint16_t *height)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = src->fb->buf,
+        .indata_size = src->fb->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = FACE_DECODE_SCALE == 8 ? JPEG_IMAGE_SCALE_1_8 : JPEG_IMAGE_SCALE_1_4,
+        .flags.swap_color_bytes = 1,
+    };
+    esp_jpeg_image_output_t img;
+
+    if (esp_jpeg_get_image_info(&cfg, &img) != ESP_OK) return ESP_FAIL;
+    if (!grow((void **)&rgb_buf, &rgb_cap, img.output_len)) return ESP_ERR_NO_MEM;
+
+    cfg.outbuf = rgb_buf;
+    cfg.outbuf_size = rgb_cap;
+    cfg.priv.read = 0;
+    if (esp_jpeg_decode(&cfg, &img) != ESP_OK) return ESP_FAIL;
+
+    *width = img.width;
+    *height = img.height;
+    return ESP_OK;
+}
+
+// --- Face Task ---
+// Decodes the newest frame at reduced scale and releases it before running
+// the detector, so the frame buffer is held for the decode only. Results are
+// published with the frame's seq for /faces.
+static void face_task(void *arg)
+{
+    int64_t window_start_us = esp_timer_get_time();
+    uint32_t window_frames = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&face_lock);
+        frame_ref_t *ref = pending;
+        pending = NULL;
+        portEXIT_CRITICAL(&face_lock);
+
+        if (!ref) continue;
+
+        uint32_t seq = ref->seq;
+        int64_t capture_us = ref->capture_us;
+        uint16_t w = 0, h = 0;
+
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = decode_scaled(ref, &w, &h);
+        frame_ref_put(ref);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Decode of frame %lu failed: 0x%x", (unsigned long)seq, err);
+            continue;
+        }
+        int64_t t1 = esp_timer_get_time();
+
+        if (!grow(&scratch, &scratch_cap, detector->scratch_size(w, h))) {
+            ESP_LOGW(TAG, "No memory for %ux%u detector scratch", w, h);
+            continue;
+        }
+
+        face_box_t boxes[FACE_MAX_BOXES];
+        int count = detector->detect(rgb_buf, w, h, scratch, boxes, FACE_MAX_BOXES);
+        int64_t t2 = esp_timer_get_time();
+
+        // Back to sensor pixels
+        for (int i = 0; i < count; i++) {
+            boxes[i].x *= FACE_DECODE_SCALE;
+            boxes[i].y *= FACE_DECODE_SCALE;
+            boxes[i].w *= FACE_DECODE_SCALE;
+            boxes[i].h *= FACE_DECODE_SCALE;
+        }
+
+        portENTER_CRITICAL(&face_lock);
+        result.seq = seq;
+        result.capture_us = capture_us;
+        result.done_us = t2;
+        result.width = w * FACE_DECODE_SCALE;
+        result.height = h * FACE_DECODE_SCALE;
+        result.count = count;
+        memcpy(result.boxes, boxes, count * sizeof(boxes[0]));
+        portEXIT_CRITICAL(&face_lock);
+
+        latency_record(LAT_FACE_DECODE, t1 - t0);
+        latency_record(LAT_FACE_DETECT, t2 - t1);
+        latency_record(LAT_CAPTURE_TO_FACES, t2 - capture_us);
+        decode_us = ewma(decode_us, (uint32_t)(t1 - t0));
+        detect_us = ewma(detect_us, (uint32_t)(t2 - t1));
+        frames_done++;
+
+        window_frames++;
+        if (t2 - window_start_us >= 1000000) {
+            rate_x10 = (uint32_t)((uint64_t)window_frames * 10000000 / (t2 - window_start_us));
+            window_frames = 0;
+            window_start_us = t2;
+        }
+    }
+}
+
+void face_result_get(face_result_t *out)
+{
+    portENTER_CRITICAL(&face_lock);
+    *out = result;
+    portEXIT_CRITICAL(&face_lock);
+}
+
+int face_json(char *buf, size_t len)
+{
+    face_result_t r;
+    portENTER_CRITICAL(&face_lock);
+    r = result;
+    uint32_t skipped = frames_skipped;
+    portEXIT_CRITICAL(&face_lock);
+
+    int off = snprintf(buf, len,
+                       "{\"seq\":%lu,\"capture_us\":%lld,\"latency_ms\":%lu,"
+                       "\"width\":%u,\"height\":%u,\"faces\":[",
+                       (unsigned long)r.seq, (long long)r.capture_us,
+                       (unsigned long)(r.seq ? (r.done_us - r.capture_us) / 1000 : 0),
+                       r.width, r.height);
+    for (int i = 0; i < r.count && off < (int)len; i++) {
+        const face_box_t *b = &r.boxes[i];
+        off += snprintf(buf + off, len - off,
+                        "%s{\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"score\":%u}",
+                        i ? "," : "", b->x, b->y, b->w, b->h, b->score);
+    }
+    if (off < (int)len) {
+        off += snprintf(buf + off, len - off,
+                        "],\"stats\":{\"detector\":\"%s\",\"scale\":%d,\"frames\":%lu,"
+                        "\"skipped\":%lu,\"per_s\":%lu.%lu,\"decode_ms\":%lu.%lu,"
+                        "\"detect_ms\":%lu.%lu",
+                        detector->name, FACE_DECODE_SCALE, (unsigned long)frames_done,
+                        (unsigned long)skipped,
+                        (unsigned long)(rate_x10 / 10), (unsigned long)(rate_x10 % 10),
+                        (unsigned long)(decode_us / 1000), (unsigned long)(decode_us / 100 % 10),
+                        (unsigned long)(detect_us / 1000), (unsigned long)(detect_us / 100 % 10));
+    }
+    if (detector == &face_detector_cascade && off < (int)len) {
+        off += snprintf(buf + off, len - off, ",\"windows\":%lu,\"passed\":%lu",
+                        (unsigned long)cascade_stats.windows, (unsigned long)cascade_stats.hits);
+    }
+    if (off < (int)len) {
+        off += snprintf(buf + off, len - off, "}}");
+    }
+    return off;
+}
+
+// Read the converted cascade from SD into PSRAM. On any failure the skin
+// detector stays in place.
+static void load_cascade(void)
+{
+    FILE *f = fopen(FACE_CASCADE_PATH, "rb");
+    if (!f) {
+        ESP_LOGI(TAG, "No cascade at %s", FACE_CASCADE_PATH);
+        return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void *data = NULL;
+    if (len > 0 && len <= FACE_CASCADE_MAX_BYTES) {
+        // heap_caps_malloc is at least 4-byte aligned, as cascade_load needs
+        data = heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    bool ok = data && fread(data, 1, len, f) == (size_t)len && cascade_load(&cascade, data, len);
+    fclose(f);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "Cascade %s unusable (%ld bytes)", FACE_CASCADE_PATH, len);
+        heap_caps_free(data);
+        return;
+    }
+
+    const cascade_params_t params = {
+        .stride = CASCADE_STRIDE,
+        .scale_step_q8 = CASCADE_SCALE_STEP_Q8,
+        .min_neighbors = CASCADE_MIN_NEIGHBORS,
+    };
+    face_cascade_set(&cascade, &params, &cascade_stats);
+    detector = &face_detector_cascade;
+    ESP_LOGI(TAG, "Cascade %s: %s %dx%d, %d stages", FACE_CASCADE_PATH,
+             cascade.type == CASCADE_HAAR ? "Haar" : "LBP", cascade.win_w, cascade.win_h,
+             cascade.n_stages);
+}
+
+void face_task_init(void)
+{
+    load_cascade();
+    xTaskCreate(face_task, "face_detect", FACE_STACK_SIZE, NULL, FACE_PRIORITY,
+                &face_task_handle);
+    ESP_LOGI(TAG, "Detector '%s' at 1/%d scale", detector->name, FACE_DECODE_SCALE);
+}
@@ -0,0 +1,149 @@
+#include "frame_poll.h"
+#include "common.h"
+#include "stream.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+static const char *TAG = "FRAME_POLL";
+
+#define POLL_STACK_SIZE     4096
+#define POLL_PRIORITY       3
+
+typedef struct {
+    httpd_req_t *req;           // detached request, NULL = free
+    uint32_t after;
+    int64_t deadline_us;
+} poll_waiter_t;
+
+static poll_waiter_t waiters[FRAME_POLL_MAX_WAITERS];
+static portMUX_TYPE waiters_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t poll_task_handle = NULL;
+
+esp_err_t frame_poll_send_frame(httpd_req_t *req, const frame_ref_t *ref)
+{
+    char seq[12];
+    char capture_us[24];
+    snprintf(seq, sizeof(seq), "%lu", (unsigned long)ref->seq);
+    snprintf(capture_us, sizeof(capture_us), "%lld", (long long)ref->capture_us);
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    httpd_resp_set_hdr(req, "X-Capture-Us", capture_us);
+    return httpd_resp_send(req, (const char *)ref->fb->buf, ref->fb->len);
+}
+
+esp_err_t frame_poll_send_timeout(httpd_req_t *req, const frame_ref_t *latest)
+{
+    char seq[12];
+    snprintf(seq, sizeof(seq), "%lu", latest ? (unsigned long)latest->seq : 0UL);
+
+    httpd_resp_set_status(req, "204 No Content");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    return httpd_resp_send(req, NULL, 0);
+}
+
+esp_err_t frame_poll_wait(httpd_req_t *req, uint32_t after, uint32_t timeout_ms)
+{
+    poll_waiter_t *slot = NULL;
+
+    portENTER_CRITICAL(&waiters_lock);
+    for (int i = 0; i < FRAME_POLL_MAX_WAITERS; i++) {
+        if (!waiters[i].req) {
+            slot = &waiters[i];
+            slot->req = req;    // reserved; replaced by the async copy below
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&waiters_lock);
+    if (!slot) return ESP_ERR_NO_MEM;
+
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        portENTER_CRITICAL(&waiters_lock);
+        slot->req = NULL;
+        portEXIT_CRITICAL(&waiters_lock);
+        return ESP_FAIL;
+    }
+
+    portENTER_CRITICAL(&waiters_lock);
+    slot->after = after;
+    slot->deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    slot->req = async_req;
+    portEXIT_CRITICAL(&waiters_lock);
+
+    // A frame may have been published since the handler looked
+    xTaskNotifyGive(poll_task_handle);
+    return ESP_OK;
+}
+
+void frame_poll_notify(void)
+{
+    if (poll_task_handle) {
+        xTaskNotifyGive(poll_task_handle);
+    }
+}
+
+// --- Poll Task ---
+// Sleeps until a frame is published, a request is parked or the earliest
+// deadline passes. Responses are sent from here, one waiter at a time, so a
+// slow consumer only delays other long-poll consumers, never the control
+// handlers on the httpd task.
+static void frame_poll_task(void *arg)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        frame_ref_t *latest = stream_latest();
+        int64_t now = esp_timer_get_time();
+        int64_t next_deadline = INT64_MAX;
+
+        for (int i = 0; i < FRAME_POLL_MAX_WAITERS; i++) {
+            poll_waiter_t *w = &waiters[i];
+
+            portENTER_CRITICAL(&waiters_lock);
+            httpd_req_t *req = w->req;
+            uint32_t after = w->after;
+            int64_t deadline_us = w->deadline_us;
+            portEXIT_CRITICAL(&waiters_lock);
+
+            // Skip free slots and ones frame_poll_wait() is still filling in
+            if (!req || !deadline_us) continue;
+
+            if (latest && frame_seq_after(latest->seq, after)) {
+                if (frame_poll_send_frame(req, latest) != ESP_OK) {
+                    ESP_LOGW(TAG, "Send of frame %lu failed", (unsigned long)latest->seq);
+                }
+            } else if (now >= deadline_us) {
+                frame_poll_send_timeout(req, latest);
+            } else {
+                if (deadline_us < next_deadline) next_deadline = deadline_us;
+                continue;
+            }
+
+            portENTER_CRITICAL(&waiters_lock);
+            w->req = NULL;
+            w->deadline_us = 0;
+            portEXIT_CRITICAL(&waiters_lock);
+            httpd_req_async_handler_complete(req);
+        }
+        frame_ref_put(latest);
+
+        if (next_deadline == INT64_MAX) {
+            wait = portMAX_DELAY;
+        } else {
+            int64_t left_us = next_deadline - esp_timer_get_time();
+            wait = left_us > 0 ? pdMS_TO_TICKS((left_us + 999) / 1000) + 1 : 0;
+        }
+    }
+}
+
+void frame_poll_init(void)
+{
+    xTaskCreate(frame_poll_task, "frame_poll", POLL_STACK_SIZE, NULL, POLL_PRIORITY,
+                &poll_task_handle);
+}
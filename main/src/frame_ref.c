@@ -0,0 +1,113 @@
+#include "frame_ref.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FRAME_REF";
+
+// Heap frames carry their camera_fb_t in the same allocation
+typedef struct {
+    frame_ref_t ref;
+    camera_fb_t fb;
+} heap_frame_t;
+
+// Every camera buffer can be wrapped at most once at a time, so one wrapper
+// per driver frame buffer is enough.
+static frame_ref_t ref_pool[CAMERA_FB_COUNT];
+static bool ref_used[CAMERA_FB_COUNT];
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t next_seq = 0;
+
+frame_ref_t *frame_ref_from_fb(camera_fb_t *fb)
+{
+    frame_ref_t *ref = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < CAMERA_FB_COUNT; i++) {
+        if (!ref_used[i]) {
+            ref_used[i] = true;
+            ref = &ref_pool[i];
+            ref->seq = ++next_seq;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!ref) {
+        ESP_LOGW(TAG, "No free frame wrapper, dropping frame");
+        esp_camera_fb_return(fb);
+        return NULL;
+    }
+
+    ref->fb = fb;
+    ref->capture_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    ref->publish_us = 0;
+    ref->heap = false;
+    atomic_store(&ref->refs, 1);
+    return ref;
+}
+
+frame_ref_t *frame_ref_from_jpeg(uint8_t *buf, size_t len, uint16_t width, uint16_t height,
+                                 const frame_ref_t *src)
+{
+    heap_frame_t *hf = calloc(1, sizeof(*hf));
+    if (!hf) {
+        free(buf);
+        return NULL;
+    }
+
+    hf->fb.buf = buf;
+    hf->fb.len = len;
+    hf->fb.width = width;
+    hf->fb.height = height;
+    hf->fb.format = PIXFORMAT_JPEG;
+    hf->fb.timestamp = src->fb->timestamp;
+
+    frame_ref_t *ref = &hf->ref;
+    ref->fb = &hf->fb;
+    ref->seq = src->seq;
+    ref->capture_us = src->capture_us;
+    ref->publish_us = esp_timer_get_time();
+    ref->heap = true;
+    atomic_store(&ref->refs, 1);
+    return ref;
+}
+
+frame_ref_t *frame_ref_copy(const frame_ref_t *src)
+{
+    const camera_fb_t *fb = src->fb;
+    uint8_t *buf = heap_caps_malloc(fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) return NULL;
+
+    memcpy(buf, fb->buf, fb->len);
+    return frame_ref_from_jpeg(buf, fb->len, fb->width, fb->height, src);
+}
+
+frame_ref_t *frame_ref_get(frame_ref_t *ref)
+{
+    atomic_fetch_add(&ref->refs, 1);
+    return ref;
+}
+
+void frame_ref_put(frame_ref_t *ref)
+{
+    if (!ref) return;
+    if (atomic_fetch_sub(&ref->refs, 1) != 1) return;
+
+    if (ref->heap) {
+        free(ref->fb->buf);
+        free(ref);      // first member of its heap_frame_t
+        return;
+    }
+
+    // Last holder: hand the buffer back to the driver and recycle the wrapper
+    esp_camera_fb_return(ref->fb);
+    ref->fb = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    ref_used[ref - ref_pool] = false;
+    portEXIT_CRITICAL(&pool_lock);
+}
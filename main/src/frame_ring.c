@@ -0,0 +1,141 @@
+#include "frame_ring.h"
+#include "esp_log.h"
+
+static const char *TAG = "FRAME_RING";
+
+esp_err_t frame_ring_init(frame_ring_t *r, uint32_t depth, frame_ring_policy_t policy)
+{
+    if (depth < 2 || depth > FRAME_RING_MAX_DEPTH || (depth & (depth - 1))) {
+        ESP_LOGE(TAG, "Invalid depth %lu (power of two, 2..%d)",
+                 (unsigned long)depth, FRAME_RING_MAX_DEPTH);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    r->mask = depth - 1;
+    r->policy = policy;
+    for (uint32_t i = 0; i < depth; i++) {
+        atomic_init(&r->cells[i].seq, i);
+        r->cells[i].ref = NULL;
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->overwritten, 0);
+    atomic_init(&r->waiting, 0);
+
+    r->space_sem = NULL;
+    if (policy == FRAME_RING_BLOCK_PRODUCER) {
+        r->space_sem = xSemaphoreCreateBinary();
+        if (!r->space_sem) return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static bool ring_try_push(frame_ring_t *r, frame_ref_t *ref)
+{
+    unsigned pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    for (;;) {
+        frame_ring_cell_t *cell = &r->cells[pos & r->mask];
+        unsigned seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            // Cell free for this position: claim it
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                cell->ref = ref;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;   // full: the cell still holds an unread frame
+        } else {
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+}
+
+frame_ref_t *frame_ring_pop(frame_ring_t *r)
+{
+    unsigned pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    frame_ring_cell_t *cell;
+
+    for (;;) {
+        cell = &r->cells[pos & r->mask];
+        unsigned seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;    // empty
+        } else {
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+
+    frame_ref_t *ref = cell->ref;
+    cell->ref = NULL;
+    // Hand the cell to the producer one lap ahead
+    atomic_store_explicit(&cell->seq, pos + r->mask + 1, memory_order_release);
+
+    if (r->space_sem && atomic_load(&r->waiting)) {
+        xSemaphoreGive(r->space_sem);
+    }
+    return ref;
+}
+
+esp_err_t frame_ring_push(frame_ring_t *r, frame_ref_t *ref, TickType_t wait)
+{
+    if (r->policy == FRAME_RING_OVERWRITE_OLDEST) {
+        while (!ring_try_push(r, ref)) {
+            // Full: make room by dropping the oldest frame
+            frame_ref_t *old = frame_ring_pop(r);
+            if (old) {
+                frame_ref_put(old);
+                atomic_fetch_add(&r->overwritten, 1);
+            }
+        }
+        return ESP_OK;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        if (ring_try_push(r, ref)) return ESP_OK;
+
+        // Announce the wait, then re-check so a pop in between is not missed
+        atomic_fetch_add(&r->waiting, 1);
+        bool pushed = ring_try_push(r, ref);
+        if (!pushed) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= wait ||
+                xSemaphoreTake(r->space_sem, wait - elapsed) != pdTRUE) {
+                atomic_fetch_sub(&r->waiting, 1);
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+        atomic_fetch_sub(&r->waiting, 1);
+        if (pushed) return ESP_OK;
+    }
+}
+
+frame_ref_t *frame_ring_pop_latest(frame_ring_t *r, uint32_t *skipped)
+{
+    frame_ref_t *latest = NULL;
+    frame_ref_t *ref;
+    uint32_t n = 0;
+
+    while ((ref = frame_ring_pop(r)) != NULL) {
+        if (latest) {
+            frame_ref_put(latest);
+            n++;
+        }
+        latest = ref;
+    }
+
+    if (skipped) *skipped = n;
+    return latest;
+}
@@ -8,13 +8,12 @@ int wifi_count = 0;
 
 volatile uint32_t total_frames_captured = 0;
 volatile uint32_t total_frames_sent = 0;
-volatile uint32_t total_frames_dropped = 0;
 
 EventGroupHandle_t wifi_event_group = NULL;
 const EventBits_t WIFI_CONNECTED_BIT = BIT0;
 
-// MJPEG client
-mjpeg_client_t mjpeg_client = {0};
+// MJPEG clients
+mjpeg_client_t mjpeg_clients[MAX_STREAM_CLIENTS] = {0};
 
 // Servo queue and positions
 QueueHandle_t servoQueue = NULL;
@@ -23,14 +22,11 @@ volatile int current_angleY = 45;
 volatile int target_angleX = 90;
 volatile int target_angleY = 45;
 
-// Двойной буфер для кадров камеры
-frame_double_buffer_t frame_buffer = {
-    .fb = { NULL, NULL },
-    .write_index = 0,
-    .read_index  = 1,
-    .ready = { false, false }
-};
-
-// HTTP server handles
-httpd_handle_t stream_server = NULL;
-httpd_handle_t control_server = NULL;
+// Captured frames, initialised by camera_init()
+frame_ring_t frame_ring;
+
+// Consumer woken by camera_capture_task on each new frame
+TaskHandle_t stream_task_handle = NULL;
+
+// HTTP server handle (stream and control)
+httpd_handle_t web_server = NULL;
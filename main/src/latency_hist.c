@@ -0,0 +1,100 @@
+#include "latency_hist.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t buckets[LAT_BUCKETS];
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t max_us;
+} lat_hist_t;
+
+static lat_hist_t hist[LAT_STAGE_MAX];
+static portMUX_TYPE hist_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const stage_names[LAT_STAGE_MAX] = {
+    [LAT_CAPTURE_TO_PUBLISH] = "capture_to_publish",
+    [LAT_RING_WAIT]          = "ring_wait",
+    [LAT_SEND]               = "send",
+    [LAT_CAPTURE_TO_SENT]    = "capture_to_sent",
+    [LAT_FACE_DECODE]        = "face_decode",
+    [LAT_FACE_DETECT]        = "face_detect",
+    [LAT_CAPTURE_TO_FACES]   = "capture_to_faces",
+};
+
+static inline int bucket_of(uint32_t us)
+{
+    // Index = bit length of the value, so bucket i holds [2^(i-1), 2^i)
+    int b = us ? 32 - __builtin_clz(us) : 0;
+    return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+void latency_record(lat_stage_t stage, int64_t us)
+{
+    if (stage >= LAT_STAGE_MAX) return;
+    if (us < 0) us = 0;
+    uint32_t v = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+
+    portENTER_CRITICAL(&hist_lock);
+    lat_hist_t *h = &hist[stage];
+    h->buckets[bucket_of(v)]++;
+    h->count++;
+    h->sum_us += v;
+    if (v > h->max_us) h->max_us = v;
+    portEXIT_CRITICAL(&hist_lock);
+}
+
+void latency_reset(void)
+{
+    portENTER_CRITICAL(&hist_lock);
+    memset(hist, 0, sizeof(hist));
+    portEXIT_CRITICAL(&hist_lock);
+}
+
+// Upper bound of the bucket holding the given percentile
+static uint32_t percentile_us(const lat_hist_t *h, uint32_t pct)
+{
+    if (!h->count) return 0;
+    uint64_t rank = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            if (i == LAT_BUCKETS - 1) return h->max_us;   // open-ended bucket
+            return i ? (1u << i) - 1 : 0;
+        }
+    }
+    return h->max_us;
+}
+
+int latency_json(char *buf, size_t len)
+{
+    // Snapshot so the report is consistent and the lock is held briefly
+    lat_hist_t snap[LAT_STAGE_MAX];
+    portENTER_CRITICAL(&hist_lock);
+    memcpy(snap, hist, sizeof(snap));
+    portEXIT_CRITICAL(&hist_lock);
+
+    int off = snprintf(buf, len, "{");
+    for (int s = 0; s < LAT_STAGE_MAX && off < (int)len; s++) {
+        const lat_hist_t *h = &snap[s];
+        off += snprintf(buf + off, len - off,
+            "%s\"%s\":{\"count\":%lu,\"mean_us\":%lu,\"max_us\":%lu,"
+            "\"p50_us\":%lu,\"p90_us\":%lu,\"p99_us\":%lu,\"buckets\":[",
+            s ? "," : "", stage_names[s],
+            (unsigned long)h->count,
+            (unsigned long)(h->count ? h->sum_us / h->count : 0),
+            (unsigned long)h->max_us,
+            (unsigned long)percentile_us(h, 50),
+            (unsigned long)percentile_us(h, 90),
+            (unsigned long)percentile_us(h, 99));
+        for (int i = 0; i < LAT_BUCKETS && off < (int)len; i++) {
+            off += snprintf(buf + off, len - off, "%s%lu", i ? "," : "",
+                            (unsigned long)h->buckets[i]);
+        }
+        if (off < (int)len) off += snprintf(buf + off, len - off, "]}");
+    }
+    if (off < (int)len) off += snprintf(buf + off, len - off, "}");
+    return off;
+}
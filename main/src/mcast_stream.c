@@ -0,0 +1,184 @@
+#include "mcast_stream.h"
+#include "common.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <errno.h>
+
+static const char *TAG = "MCAST";
+
+#define MCAST_STACK_SIZE    3072
+#define MCAST_PRIORITY      3
+#define MCAST_NOMEM_RETRIES 5       // ticks to wait for lwIP buffers per datagram
+
+static int mcast_fd = -1;
+static uint8_t parity_buf[MCAST_FRAG_PAYLOAD] __attribute__((aligned(4)));
+static struct sockaddr_in group_addr;
+static TaskHandle_t mcast_task_handle = NULL;
+
+// Newest frame not yet sent, handed over by mcast_publish()
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_ref_t *pending = NULL;
+
+void mcast_publish(frame_ref_t *ref)
+{
+    if (!mcast_task_handle) return;
+
+    portENTER_CRITICAL(&pending_lock);
+    frame_ref_t *old = pending;
+    pending = frame_ref_get(ref);
+    portEXIT_CRITICAL(&pending_lock);
+
+    if (old) {
+        drop_count(DROP_CLIENT_CONGESTED, 1);
+        frame_ref_put(old);
+    }
+    xTaskNotifyGive(mcast_task_handle);
+}
+
+static esp_err_t send_datagram(const struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg = {
+        .msg_name = &group_addr,
+        .msg_namelen = sizeof(group_addr),
+        .msg_iov = (struct iovec *)iov,
+        .msg_iovlen = iovcnt,
+    };
+
+    // A burst of fragments can outrun lwIP's buffers: wait a tick and retry
+    for (int i = 0; i <= MCAST_NOMEM_RETRIES; i++) {
+        if (sendmsg(mcast_fd, &msg, 0) >= 0) return ESP_OK;
+        if (errno != ENOMEM && errno != EAGAIN) return ESP_FAIL;
+        vTaskDelay(1);
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+// parity_buf ^= src, word at a time while both are aligned
+static void parity_add(const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    if (((uintptr_t)src & 3) == 0) {
+        uint32_t *dst32 = (uint32_t *)parity_buf;
+        const uint32_t *src32 = (const uint32_t *)src;
+        for (; i + 4 <= len; i += 4) {
+            dst32[i / 4] ^= src32[i / 4];
+        }
+    }
+    for (; i < len; i++) {
+        parity_buf[i] ^= src[i];
+    }
+}
+
+static esp_err_t send_parity(mcast_frag_hdr_t hdr, uint16_t first, size_t len)
+{
+    hdr.flags = MCAST_FLAG_PARITY;
+    hdr.frag_idx = first;
+    hdr.offset = (uint32_t)first * MCAST_FRAG_PAYLOAD;
+    hdr.frag_len = len;
+
+    struct iovec iov[2] = {
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = parity_buf, .iov_len = len },
+    };
+    return send_datagram(iov, 2);
+}
+
+static esp_err_t send_frame(const frame_ref_t *ref)
+{
+    const camera_fb_t *fb = ref->fb;
+    uint16_t count = (fb->len + MCAST_FRAG_PAYLOAD - 1) / MCAST_FRAG_PAYLOAD;
+    mcast_frag_hdr_t hdr = {
+        .magic = MCAST_MAGIC,
+        .version = MCAST_VERSION,
+        .frame_seq = ref->seq,
+        .frame_len = fb->len,
+        .frag_count = count,
+        .fec_group = MCAST_FEC_GROUP,
+        .capture_us = ref->capture_us,
+    };
+#if MCAST_FEC_GROUP > 0
+    size_t parity_len = 0;
+#endif
+
+    for (uint16_t i = 0; i < count; i++) {
+        size_t off = (size_t)i * MCAST_FRAG_PAYLOAD;
+        size_t len = fb->len - off < MCAST_FRAG_PAYLOAD ? fb->len - off : MCAST_FRAG_PAYLOAD;
+
+        hdr.offset = off;
+        hdr.frag_idx = i;
+        hdr.frag_len = len;
+
+        struct iovec iov[2] = {
+            { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+            { .iov_base = fb->buf + off, .iov_len = len },
+        };
+        esp_err_t err = send_datagram(iov, 2);
+        if (err != ESP_OK) return err;
+
+#if MCAST_FEC_GROUP > 0
+        uint16_t first = i - i % MCAST_FEC_GROUP;
+        if (i == first) {
+            memset(parity_buf, 0, sizeof(parity_buf));
+            parity_len = 0;
+        }
+        parity_add(fb->buf + off, len);
+        if (len > parity_len) parity_len = len;
+
+        if (i - first == MCAST_FEC_GROUP - 1 || i == count - 1) {
+            err = send_parity(hdr, first, parity_len);
+            if (err != ESP_OK) return err;
+        }
+#endif
+    }
+    return ESP_OK;
+}
+
+// --- Multicast Task ---
+// One copy of every frame goes out no matter how many receivers joined.
+// Lost datagrams are not retransmitted: the receiver rebuilds them from
+// parity or drops the frame, so a loss never stalls later frames.
+// Only the newest frame waits; a frame published mid-send replaces the next one.
+static void mcast_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&pending_lock);
+        frame_ref_t *ref = pending;
+        pending = NULL;
+        portEXIT_CRITICAL(&pending_lock);
+
+        if (!ref) continue;
+
+        if (send_frame(ref) == ESP_OK) {
+            total_frames_sent++;
+        } else {
+            drop_count(DROP_SEND_FAIL, 1);
+        }
+        frame_ref_put(ref);
+    }
+}
+
+esp_err_t mcast_stream_start(void)
+{
+    mcast_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (mcast_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create socket");
+        return ESP_FAIL;
+    }
+
+    uint8_t ttl = MCAST_TTL;
+    setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    uint8_t loop = 0;
+    setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htons(MCAST_PORT);
+    group_addr.sin_addr.s_addr = inet_addr(MCAST_GROUP);
+
+    xTaskCreate(mcast_task, "mcast_stream", MCAST_STACK_SIZE, NULL, MCAST_PRIORITY,
+                &mcast_task_handle);
+    ESP_LOGI(TAG, "Multicast stream to %s:%d", MCAST_GROUP, MCAST_PORT);
+    return ESP_OK;
+}
@@ -0,0 +1,134 @@
+#include "model_store.h"
+#include "nn_model.h"
+#include "common.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "MODEL";
+
+static nn_model_t model;
+static nn_tensor_t tensors[NN_MAX_TENSORS];
+static nn_op_t *ops = NULL;
+static nn_arena_t arena;
+static bool loaded = false;
+static const char *error = "disabled";  // why nothing is loaded
+
+static esp_partition_mmap_handle_t map_handle;
+static nn_model_hdr_t hdr;
+
+static const uint32_t arena_caps[NN_MEM_REGIONS] = {
+    [NN_MEM_INTERNAL] = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    [NN_MEM_PSRAM]    = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+};
+
+static bool load(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           MODEL_PARTITION_SUBTYPE,
+                                                           MODEL_PARTITION);
+    if (!part) {
+        error = "no model partition";
+        return false;
+    }
+
+    // Size from the header, so only the image is mapped, not the whole partition
+    if (esp_partition_read(part, 0, &hdr, sizeof(hdr)) != ESP_OK) {
+        error = "partition read failed";
+        return false;
+    }
+    if (hdr.magic != NN_MODEL_MAGIC) {
+        error = "partition empty";
+        return false;
+    }
+    if (hdr.version != NN_MODEL_VERSION) {
+        ESP_LOGE(TAG, "Model format v%u, firmware reads v%u", hdr.version, NN_MODEL_VERSION);
+        error = "unsupported format version";
+        return false;
+    }
+    if (hdr.total_size < sizeof(hdr) || hdr.total_size > part->size ||
+        hdr.n_ops > NN_MODEL_MAX_OPS) {
+        error = "bad header";
+        return false;
+    }
+
+    const void *data;
+    esp_err_t err = esp_partition_mmap(part, 0, hdr.total_size, ESP_PARTITION_MMAP_DATA,
+                                       &data, &map_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "mmap of %lu bytes failed: %s", (unsigned long)hdr.total_size,
+                 esp_err_to_name(err));
+        error = "mmap failed";
+        return false;
+    }
+
+    ops = calloc(hdr.n_ops ? hdr.n_ops : 1, sizeof(nn_op_t));
+    error = ops ? nn_model_load(data, hdr.total_size, &model, tensors, ops, hdr.n_ops)
+                : "no memory";
+    if (!error && !nn_plan(&model, NN_INTERNAL_BUDGET)) error = "inconsistent graph";
+    if (!error) return true;
+
+    free(ops);
+    ops = NULL;
+    esp_partition_munmap(map_handle);
+    return false;
+}
+
+void model_store_init(void)
+{
+    loaded = load();
+    if (!loaded) {
+        ESP_LOGW(TAG, "No model: %s", error);
+        return;
+    }
+    ESP_LOGI(TAG, "'%.*s': %u ops, %lu bytes mapped, arenas %u internal + %u PSRAM on first use",
+             (int)sizeof(hdr.name), hdr.name, model.n_ops, (unsigned long)hdr.total_size,
+             (unsigned)model.arena_size[NN_MEM_INTERNAL],
+             (unsigned)model.arena_size[NN_MEM_PSRAM]);
+}
+
+// Arenas are taken on first use, so internal RAM stays with the camera and
+// httpd until something actually runs the model
+static bool alloc_arenas(void)
+{
+    for (int r = 0; r < NN_MEM_REGIONS; r++) {
+        if (!model.arena_size[r] || arena.base[r]) continue;
+        arena.base[r] = heap_caps_aligned_alloc(NN_ARENA_ALIGN, model.arena_size[r],
+                                                arena_caps[r]);
+        if (!arena.base[r]) {
+            ESP_LOGE(TAG, "No memory for the %u byte %s arena", (unsigned)model.arena_size[r],
+                     r == NN_MEM_INTERNAL ? "internal" : "PSRAM");
+            for (int i = 0; i < NN_MEM_REGIONS; i++) {
+                heap_caps_free(arena.base[i]);
+                arena.base[i] = NULL;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+const nn_model_t *model_store_get(nn_arena_t *out)
+{
+    if (!loaded || !alloc_arenas()) return NULL;
+    *out = arena;
+    return &model;
+}
+
+int model_json(char *buf, size_t len)
+{
+    if (!loaded) {
+        return snprintf(buf, len, "{\"loaded\":false,\"error\":\"%s\"}", error);
+    }
+
+    int off = snprintf(buf, len,
+                       "{\"loaded\":true,\"name\":\"%.*s\",\"version\":%u,\"bytes\":%lu,"
+                       "\"crc32\":\"%08lx\",\"plan\":",
+                       (int)sizeof(hdr.name), hdr.name, hdr.version,
+                       (unsigned long)hdr.total_size, (unsigned long)hdr.crc32);
+    if (off < (int)len) off += nn_plan_json(&model, buf + off, len - off);
+    if (off < (int)len) off += snprintf(buf + off, len - off, "}");
+    return off;
+}
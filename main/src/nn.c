@@ -0,0 +1,455 @@
+#include "nn.h"
+#include <stdio.h>
+#include <string.h>
+
+// --- Requantization ---
+// gemmlowp's SaturatingRoundingDoublingHighMul and RoundingDivideByPOT, as
+// TFLite's MultiplyByQuantizedMultiplier: results match its int8 kernels.
+
+static inline int32_t high_mul(int32_t a, int32_t b)
+{
+    if (a == INT32_MIN && b == INT32_MIN) return INT32_MAX;
+    int64_t ab = (int64_t)a * b;
+    int64_t nudge = ab >= 0 ? (1 << 30) : 1 - (1 << 30);
+    return (int32_t)((ab + nudge) / (1ll << 31));
+}
+
+static inline int32_t divide_pot(int32_t x, int exponent)
+{
+    const int32_t mask = (int32_t)((1ull << exponent) - 1);
+    const int32_t remainder = x & mask;
+    const int32_t threshold = (mask >> 1) + (x < 0);
+    return (x >> exponent) + (remainder > threshold);
+}
+
+static inline int8_t requantize(int32_t acc, int32_t multiplier, int shift, int32_t zero_point,
+                                int32_t act_min, int32_t act_max)
+{
+    int32_t v = shift > 0 ? (int32_t)((uint32_t)acc << shift) : acc;
+    v = divide_pot(high_mul(v, multiplier), shift > 0 ? 0 : -shift) + zero_point;
+    return (int8_t)(v < act_min ? act_min : v > act_max ? act_max : v);
+}
+
+static inline int8_t sat8(int32_t v)
+{
+    return (int8_t)(v < INT8_MIN ? INT8_MIN : v > INT8_MAX ? INT8_MAX : v);
+}
+
+// Taps of a window starting at `start` (may be negative) that fall inside 0..size
+static inline void taps(int start, int k, int size, int *first, int *end)
+{
+    *first = start < 0 ? -start : 0;
+    *end = start + k > size ? size - start : k;
+}
+
+// --- Kernels ---
+
+static void conv2d(const nn_op_t *op, const nn_tensor_t *in, const nn_tensor_t *out,
+                   const int8_t *x, int8_t *y)
+{
+    const int32_t in_off = -in->zero_point;
+    const int ic = in->c;
+    const size_t filter = (size_t)op->kh * op->kw * ic;
+
+    for (int oy = 0; oy < out->h; oy++) {
+        const int y0 = oy * op->stride - op->pad_t;
+        int ky0, ky1;
+        taps(y0, op->kh, in->h, &ky0, &ky1);
+
+        for (int ox = 0; ox < out->w; ox++) {
+            const int x0 = ox * op->stride - op->pad_l;
+            int kx0, kx1;
+            taps(x0, op->kw, in->w, &kx0, &kx1);
+            // HWC: the taps of one filter row are contiguous in input and weights
+            const int run = (kx1 - kx0) * ic;
+
+            for (int o = 0; o < out->c; o++) {
+                const int8_t *w = op->weights + o * filter;
+                int32_t acc = op->bias ? op->bias[o] : 0;
+
+                for (int ky = ky0; ky < ky1; ky++) {
+                    const int8_t *xr = x + ((size_t)(y0 + ky) * in->w + x0 + kx0) * ic;
+                    const int8_t *wr = w + ((size_t)ky * op->kw + kx0) * ic;
+                    for (int i = 0; i < run; i++) {
+                        acc += wr[i] * (xr[i] + in_off);
+                    }
+                }
+                *y++ = requantize(acc, op->multiplier[o], op->shift[o], out->zero_point,
+                                  op->act_min, op->act_max);
+            }
+        }
+    }
+}
+
+static void dwconv2d(const nn_op_t *op, const nn_tensor_t *in, const nn_tensor_t *out,
+                     const int8_t *x, int8_t *y)
+{
+    const int32_t in_off = -in->zero_point;
+    const int c = in->c;
+
+    for (int oy = 0; oy < out->h; oy++) {
+        const int y0 = oy * op->stride - op->pad_t;
+        int ky0, ky1;
+        taps(y0, op->kh, in->h, &ky0, &ky1);
+
+        for (int ox = 0; ox < out->w; ox++) {
+            const int x0 = ox * op->stride - op->pad_l;
+            int kx0, kx1;
+            taps(x0, op->kw, in->w, &kx0, &kx1);
+
+            for (int ch = 0; ch < c; ch++) {
+                int32_t acc = op->bias ? op->bias[ch] : 0;
+                for (int ky = ky0; ky < ky1; ky++) {
+                    const int8_t *xr = x + ((size_t)(y0 + ky) * in->w + x0) * c + ch;
+                    const int8_t *wr = op->weights + (size_t)ky * op->kw * c + ch;
+                    for (int kx = kx0; kx < kx1; kx++) {
+                        acc += wr[kx * c] * (xr[kx * c] + in_off);
+                    }
+                }
+                *y++ = requantize(acc, op->multiplier[ch], op->shift[ch], out->zero_point,
+                                  op->act_min, op->act_max);
+            }
+        }
+    }
+}
+
+static void pool(const nn_op_t *op, const nn_tensor_t *in, const nn_tensor_t *out,
+                 const int8_t *x, int8_t *y)
+{
+    const int c = in->c;
+
+    for (int oy = 0; oy < out->h; oy++) {
+        const int y0 = oy * op->stride - op->pad_t;
+        int ky0, ky1;
+        taps(y0, op->kh, in->h, &ky0, &ky1);
+
+        for (int ox = 0; ox < out->w; ox++) {
+            const int x0 = ox * op->stride - op->pad_l;
+            int kx0, kx1;
+            taps(x0, op->kw, in->w, &kx0, &kx1);
+            const int count = (ky1 - ky0) * (kx1 - kx0);
+
+            for (int ch = 0; ch < c; ch++) {
+                int32_t v;
+                if (op->type == NN_MAXPOOL) {
+                    v = INT8_MIN;
+                    for (int ky = ky0; ky < ky1; ky++) {
+                        const int8_t *xr = x + ((size_t)(y0 + ky) * in->w + x0) * c + ch;
+                        for (int kx = kx0; kx < kx1; kx++) {
+                            if (xr[kx * c] > v) v = xr[kx * c];
+                        }
+                    }
+                } else {
+                    int32_t sum = 0;
+                    for (int ky = ky0; ky < ky1; ky++) {
+                        const int8_t *xr = x + ((size_t)(y0 + ky) * in->w + x0) * c + ch;
+                        for (int kx = kx0; kx < kx1; kx++) {
+                            sum += xr[kx * c];
+                        }
+                    }
+                    // Rounded half away from zero, as TFLite's AveragePool
+                    v = sum > 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+                }
+                *y++ = (int8_t)(v < op->act_min ? op->act_min : v > op->act_max ? op->act_max : v);
+            }
+        }
+    }
+}
+
+static void relu(const nn_op_t *op, const nn_tensor_t *t, const int8_t *x, int8_t *y)
+{
+    const size_t n = (size_t)t->h * t->w * t->c;
+    for (size_t i = 0; i < n; i++) {
+        y[i] = x[i] < op->act_min ? op->act_min : x[i] > op->act_max ? op->act_max : x[i];
+    }
+}
+
+// --- Planning ---
+
+// Window placement: every output position has at least one tap inside the input
+static bool window_ok(int in, int out, int k, int stride, int pad)
+{
+    return k >= 1 && stride >= 1 && pad < k && out >= 1 && (out - 1) * stride - pad < in;
+}
+
+static bool op_ok(const nn_model_t *m, const nn_op_t *op)
+{
+    const nn_tensor_t *in = &m->tensors[op->input];
+    const nn_tensor_t *out = &m->tensors[op->output];
+
+    if (op->act_min > op->act_max) return false;
+
+    switch (op->type) {
+    case NN_CONV2D:
+    case NN_DWCONV2D:
+        if (!op->weights || !op->multiplier || !op->shift) return false;
+        if (op->type == NN_DWCONV2D && out->c != in->c) return false;
+        for (int o = 0; o < out->c; o++) {
+            if (op->shift[o] < -31 || op->shift[o] > 7) return false;
+        }
+        break;
+    case NN_MAXPOOL:
+    case NN_AVGPOOL:
+        if (out->c != in->c || out->zero_point != in->zero_point) return false;
+        break;
+    case NN_RELU:
+        return out->h == in->h && out->w == in->w && out->c == in->c &&
+               out->zero_point == in->zero_point;
+    default:
+        return false;
+    }
+    return op->input != op->output &&
+           window_ok(in->h, out->h, op->kh, op->stride, op->pad_t) &&
+           window_ok(in->w, out->w, op->kw, op->stride, op->pad_l);
+}
+
+static size_t tensor_bytes(const nn_tensor_t *t)
+{
+    size_t n = (size_t)t->h * t->w * t->c;
+    return (n + NN_ARENA_ALIGN - 1) & ~(size_t)(NN_ARENA_ALIGN - 1);
+}
+
+// Ops a tensor is live across; -1 is the input fill before the first op
+typedef struct {
+    int16_t first;
+    int16_t last;
+} life_t;
+
+static void lifetimes(const nn_model_t *m, life_t *life)
+{
+    bool read[NN_MAX_TENSORS] = { false };
+
+    for (int i = 0; i < m->n_tensors; i++) {
+        life[i] = (life_t) { INT16_MAX, -1 };
+    }
+    life[m->input].first = -1;
+    for (int i = 0; i < m->n_ops; i++) {
+        const nn_op_t *op = &m->ops[i];
+        if (life[op->output].first > i) life[op->output].first = i;
+        life[op->input].last = i;
+        life[op->output].last = i;
+        // An in-place op does not consume its tensor
+        if (op->input != op->output) read[op->input] = true;
+    }
+    for (int i = 0; i < m->n_tensors; i++) {
+        if (i == m->output || !read[i]) life[i].last = m->n_ops;
+    }
+}
+
+// Kernel reads and writes of each tensor over one run
+static void accesses(const nn_model_t *m, uint64_t *count)
+{
+    memset(count, 0, m->n_tensors * sizeof(*count));
+    for (int i = 0; i < m->n_ops; i++) {
+        const nn_op_t *op = &m->ops[i];
+        const nn_tensor_t *in = &m->tensors[op->input];
+        const nn_tensor_t *out = &m->tensors[op->output];
+        uint64_t outputs = (uint64_t)out->h * out->w * out->c;
+
+        switch (op->type) {
+        case NN_CONV2D:
+            count[op->input] += outputs * op->kh * op->kw * in->c;
+            break;
+        case NN_DWCONV2D:
+        case NN_MAXPOOL:
+        case NN_AVGPOOL:
+            count[op->input] += outputs * op->kh * op->kw;
+            break;
+        default:
+            count[op->input] += outputs;
+            break;
+        }
+        count[op->output] += outputs;
+    }
+}
+
+// Place the tensors of one region, largest first, each at the lowest offset
+// clear of the already placed tensors it is live with. Returns the arena size.
+static size_t pack(nn_model_t *m, const life_t *life, uint8_t region)
+{
+    int order[NN_MAX_TENSORS];
+    int n = 0;
+    for (int i = 0; i < m->n_tensors; i++) {
+        if (m->tensors[i].region != region) continue;
+        int pos = n++;
+        while (pos > 0 && tensor_bytes(&m->tensors[order[pos - 1]]) < tensor_bytes(&m->tensors[i])) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = i;
+    }
+
+    size_t size = 0;
+    for (int k = 0; k < n; k++) {
+        nn_tensor_t *t = &m->tensors[order[k]];
+        const life_t *lt = &life[order[k]];
+
+        // Placed tensors live at the same time, by offset
+        const nn_tensor_t *busy[NN_MAX_TENSORS];
+        int n_busy = 0;
+        for (int j = 0; j < k; j++) {
+            const life_t *lp = &life[order[j]];
+            if (lp->first > lt->last || lt->first > lp->last) continue;
+            const nn_tensor_t *p = &m->tensors[order[j]];
+            int pos = n_busy++;
+            while (pos > 0 && busy[pos - 1]->offset > p->offset) {
+                busy[pos] = busy[pos - 1];
+                pos--;
+            }
+            busy[pos] = p;
+        }
+
+        size_t offset = 0;
+        const size_t bytes = tensor_bytes(t);
+        for (int j = 0; j < n_busy; j++) {
+            if (offset + bytes <= busy[j]->offset) break;
+            size_t end = busy[j]->offset + tensor_bytes(busy[j]);
+            if (end > offset) offset = end;
+        }
+        t->offset = offset;
+        if (offset + bytes > size) size = offset + bytes;
+    }
+    return size;
+}
+
+bool nn_plan(nn_model_t *m, size_t internal_budget)
+{
+    if (m->n_tensors < 1 || m->n_tensors > NN_MAX_TENSORS ||
+        m->input < 0 || m->input >= m->n_tensors ||
+        m->output < 0 || m->output >= m->n_tensors) {
+        return false;
+    }
+
+    bool written[NN_MAX_TENSORS] = { false };
+    written[m->input] = true;
+    for (int i = 0; i < m->n_ops; i++) {
+        const nn_op_t *op = &m->ops[i];
+        if (op->input >= m->n_tensors || op->output >= m->n_tensors ||
+            !written[op->input] || (written[op->output] && op->input != op->output) ||
+            !op_ok(m, op)) {
+            return false;
+        }
+        written[op->output] = true;
+    }
+    for (int i = 0; i < m->n_tensors; i++) {
+        const nn_tensor_t *t = &m->tensors[i];
+        if (!written[i] || !t->h || !t->w || !t->c) return false;
+    }
+
+    life_t life[NN_MAX_TENSORS];
+    uint64_t count[NN_MAX_TENSORS];
+    lifetimes(m, life);
+    accesses(m, count);
+
+    // Hottest first: most accesses per byte
+    int order[NN_MAX_TENSORS];
+    for (int i = 0; i < m->n_tensors; i++) {
+        int pos = i;
+        while (pos > 0 && count[order[pos - 1]] * tensor_bytes(&m->tensors[i]) <
+                          count[i] * tensor_bytes(&m->tensors[order[pos - 1]])) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = i;
+        m->tensors[i].region = NN_MEM_PSRAM;
+    }
+
+    // Grow the internal set while it still packs into the budget
+    for (int k = 0; k < m->n_tensors; k++) {
+        nn_tensor_t *t = &m->tensors[order[k]];
+        if (tensor_bytes(t) > internal_budget) continue;
+        t->region = NN_MEM_INTERNAL;
+        if (pack(m, life, NN_MEM_INTERNAL) > internal_budget) {
+            t->region = NN_MEM_PSRAM;
+        }
+    }
+
+    m->arena_size[NN_MEM_INTERNAL] = pack(m, life, NN_MEM_INTERNAL);
+    m->arena_size[NN_MEM_PSRAM] = pack(m, life, NN_MEM_PSRAM);
+    return true;
+}
+
+int nn_plan_json(const nn_model_t *m, char *buf, size_t len)
+{
+    life_t life[NN_MAX_TENSORS];
+    lifetimes(m, life);
+
+    size_t naive = 0;
+    for (int i = 0; i < m->n_tensors; i++) {
+        naive += tensor_bytes(&m->tensors[i]);
+    }
+    size_t live_peak = 0;
+    int live_peak_op = 0;
+    for (int op = 0; op < m->n_ops; op++) {
+        size_t live = 0;
+        for (int i = 0; i < m->n_tensors; i++) {
+            if (life[i].first <= op && op <= life[i].last) live += tensor_bytes(&m->tensors[i]);
+        }
+        if (live > live_peak) {
+            live_peak = live;
+            live_peak_op = op;
+        }
+    }
+
+    int off = snprintf(buf, len,
+                       "{\"ops\":%d,\"unshared\":%u,\"live_peak\":%u,\"live_peak_op\":%d,"
+                       "\"internal\":%u,\"psram\":%u,\"tensors\":[",
+                       m->n_ops, (unsigned)naive, (unsigned)live_peak, live_peak_op,
+                       (unsigned)m->arena_size[NN_MEM_INTERNAL],
+                       (unsigned)m->arena_size[NN_MEM_PSRAM]);
+    for (int i = 0; i < m->n_tensors && off < (int)len; i++) {
+        const nn_tensor_t *t = &m->tensors[i];
+        off += snprintf(buf + off, len - off,
+                        "%s{\"bytes\":%u,\"live\":[%d,%d],\"mem\":\"%s\",\"offset\":%u}",
+                        i ? "," : "", (unsigned)tensor_bytes(t), life[i].first, life[i].last,
+                        t->region == NN_MEM_INTERNAL ? "internal" : "psram",
+                        (unsigned)t->offset);
+    }
+    if (off < (int)len) {
+        off += snprintf(buf + off, len - off, "]}");
+    }
+    return off;
+}
+
+// --- Running ---
+
+void nn_input_rgb565(const nn_model_t *m, const nn_arena_t *arena, const uint8_t *rgb565,
+                     int width, int height, bool big_endian)
+{
+    const nn_tensor_t *t = &m->tensors[m->input];
+    if (t->c != 3) return;
+
+    int8_t *y = nn_tensor_data(m, arena, m->input);
+    const int hi = big_endian ? 0 : 1;
+    for (int ty = 0; ty < t->h; ty++) {
+        const uint8_t *row = rgb565 + (size_t)(ty * height / t->h) * width * 2;
+        for (int tx = 0; tx < t->w; tx++) {
+            const uint8_t *px = row + (size_t)(tx * width / t->w) * 2;
+            uint16_t v = (uint16_t)(px[hi] << 8 | px[hi ^ 1]);
+            int r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+            // Widen 5/6 bits to 8 by repeating the top bits
+            *y++ = sat8(((r << 3) | (r >> 2)) + t->zero_point);
+            *y++ = sat8(((g << 2) | (g >> 4)) + t->zero_point);
+            *y++ = sat8(((b << 3) | (b >> 2)) + t->zero_point);
+        }
+    }
+}
+
+void nn_run(const nn_model_t *m, const nn_arena_t *arena)
+{
+    for (int i = 0; i < m->n_ops; i++) {
+        const nn_op_t *op = &m->ops[i];
+        const nn_tensor_t *in = &m->tensors[op->input];
+        const nn_tensor_t *out = &m->tensors[op->output];
+        const int8_t *x = nn_tensor_data(m, arena, op->input);
+        int8_t *y = nn_tensor_data(m, arena, op->output);
+
+        switch (op->type) {
+        case NN_CONV2D:   conv2d(op, in, out, x, y); break;
+        case NN_DWCONV2D: dwconv2d(op, in, out, x, y); break;
+        case NN_MAXPOOL:
+        case NN_AVGPOOL:  pool(op, in, out, x, y); break;
+        case NN_RELU:     relu(op, in, x, y); break;
+        }
+    }
+}
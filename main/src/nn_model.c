@@ -0,0 +1,127 @@
+#include "nn_model.h"
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+_Static_assert(sizeof(nn_model_hdr_t) == 48, "file layout");
+_Static_assert(sizeof(nn_model_tensor_t) == 8, "file layout");
+_Static_assert(sizeof(nn_model_op_t) == 28, "file layout");
+
+static uint32_t crc32(const uint8_t *p, size_t len)
+{
+#ifdef ESP_PLATFORM
+    return esp_rom_crc32_le(0, p, len);
+#else
+    // zlib's CRC-32, four bits at a time
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+        0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return ~crc;
+#endif
+}
+
+// Blob of `bytes` at `offset`, past the tables and inside the image
+static const void *blob(const uint8_t *base, uint32_t offset, size_t bytes, size_t data_start,
+                        size_t total, size_t align)
+{
+    if (offset == NN_MODEL_NONE || offset < data_start || offset % align ||
+        offset > total || bytes > total - offset) {
+        return NULL;
+    }
+    return base + offset;
+}
+
+// Up to 24 of [A-Za-z0-9_.-], NUL padded; it goes into /model JSON as is
+static bool name_ok(const char *name, size_t size)
+{
+    size_t n = 0;
+    while (n < size && name[n]) {
+        char ch = name[n++];
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+              (ch >= '0' && ch <= '9') || ch == '_' || ch == '.' || ch == '-')) {
+            return false;
+        }
+    }
+    for (; n < size; n++) {
+        if (name[n]) return false;
+    }
+    return true;
+}
+
+const char *nn_model_load(const void *data, size_t len, nn_model_t *m,
+                          nn_tensor_t *tensors, nn_op_t *ops, int max_ops)
+{
+    const nn_model_hdr_t *hdr = data;
+    const uint8_t *base = data;
+
+    if (((uintptr_t)data & 3) || len < sizeof(*hdr) || hdr->magic != NN_MODEL_MAGIC) {
+        return "no model image";
+    }
+    if (hdr->version != NN_MODEL_VERSION) return "unsupported format version";
+    if (hdr->header_size < sizeof(*hdr) || hdr->header_size % 4 ||
+        hdr->total_size > len || hdr->total_size < hdr->header_size) {
+        return "bad header";
+    }
+    if (hdr->n_tensors < 1 || hdr->n_tensors > NN_MAX_TENSORS || hdr->n_ops > max_ops) {
+        return "too many tensors or ops";
+    }
+    if (hdr->input >= hdr->n_tensors || hdr->output >= hdr->n_tensors) return "bad header";
+    if (!name_ok(hdr->name, sizeof(hdr->name))) return "bad name";
+
+    const size_t tables = hdr->header_size + hdr->n_tensors * sizeof(nn_model_tensor_t) +
+                          hdr->n_ops * sizeof(nn_model_op_t);
+    if (tables > hdr->total_size) return "truncated";
+    if (crc32(base + hdr->header_size, hdr->total_size - hdr->header_size) != hdr->crc32) {
+        return "checksum mismatch";
+    }
+
+    const nn_model_tensor_t *ft = (const nn_model_tensor_t *)(base + hdr->header_size);
+    const nn_model_op_t *fo = (const nn_model_op_t *)(ft + hdr->n_tensors);
+
+    for (int i = 0; i < hdr->n_tensors; i++) {
+        tensors[i] = (nn_tensor_t) {
+            .h = ft[i].h, .w = ft[i].w, .c = ft[i].c, .zero_point = ft[i].zero_point,
+        };
+    }
+
+    for (int i = 0; i < hdr->n_ops; i++) {
+        const nn_model_op_t *f = &fo[i];
+        if (f->input >= hdr->n_tensors || f->output >= hdr->n_tensors) return "bad op";
+
+        ops[i] = (nn_op_t) {
+            .type = f->type, .kh = f->kh, .kw = f->kw, .stride = f->stride,
+            .pad_t = f->pad_t, .pad_l = f->pad_l,
+            .act_min = f->act_min, .act_max = f->act_max,
+            .input = f->input, .output = f->output,
+        };
+        if (f->type != NN_CONV2D && f->type != NN_DWCONV2D) continue;
+
+        const nn_tensor_t *in = &tensors[f->input];
+        const size_t out_c = tensors[f->output].c;
+        const size_t n_weights = (size_t)f->kh * f->kw *
+                                 (f->type == NN_CONV2D ? out_c * in->c : in->c);
+        ops[i].weights = blob(base, f->weights, n_weights, tables, hdr->total_size, 1);
+        ops[i].multiplier = blob(base, f->multiplier, out_c * 4, tables, hdr->total_size, 4);
+        ops[i].shift = blob(base, f->shift, out_c, tables, hdr->total_size, 1);
+        if (f->bias != NN_MODEL_NONE) {
+            ops[i].bias = blob(base, f->bias, out_c * 4, tables, hdr->total_size, 4);
+            if (!ops[i].bias) return "bad blob";
+        }
+        if (!ops[i].weights || !ops[i].multiplier || !ops[i].shift) return "bad blob";
+    }
+
+    *m = (nn_model_t) {
+        .n_tensors = hdr->n_tensors, .tensors = tensors,
+        .n_ops = hdr->n_ops, .ops = ops,
+        .input = hdr->input, .output = hdr->output,
+    };
+    return NULL;
+}
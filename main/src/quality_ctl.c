@@ -0,0 +1,183 @@
+#include "quality_ctl.h"
+#include "common.h"
+#include "esp_camera.h"
+#include "esp_log.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+static const char *TAG = "QUALITY_CTL";
+
+#define QCTL_STACK_SIZE     3072
+#define QCTL_PRIORITY       2
+
+// Frame sizes the controller may pick, smallest first. The largest must be
+// CAMERA_FRAME_SIZE, which the frame buffers were allocated for.
+static const framesize_t size_ladder[] = {
+    FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_HVGA, FRAMESIZE_VGA,
+};
+static const char *const size_names[] = { "QVGA", "CIF", "HVGA", "VGA" };
+#define SIZE_STEPS  (int)(sizeof(size_ladder) / sizeof(size_ladder[0]))
+
+_Static_assert(sizeof(size_names) / sizeof(size_names[0]) == SIZE_STEPS,
+               "size_names must match size_ladder");
+
+// Filled by stream_task and the stream engine, drained every period
+static atomic_uint period_bytes;
+static atomic_uint period_frames;
+static atomic_uint sent_count;
+static atomic_ullong sent_sum_us;
+static atomic_uint skip_count;
+
+// Controller state, written by its task only
+static int quality = CAMERA_JPEG_QUALITY;
+static int size_idx = SIZE_STEPS - 1;
+static uint32_t last_kbps;
+static uint32_t last_latency_ms;
+static uint32_t last_congested_pct;
+
+void quality_ctl_frame(size_t bytes)
+{
+    atomic_fetch_add_explicit(&period_bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&period_frames, 1, memory_order_relaxed);
+}
+
+void quality_ctl_sent(int64_t latency_us)
+{
+    atomic_fetch_add_explicit(&sent_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sent_sum_us, latency_us > 0 ? latency_us : 0,
+                              memory_order_relaxed);
+}
+
+void quality_ctl_skipped(void)
+{
+    atomic_fetch_add_explicit(&skip_count, 1, memory_order_relaxed);
+}
+
+static uint32_t pixels(int idx)
+{
+    return (uint32_t)resolution[size_ladder[idx]].width * resolution[size_ladder[idx]].height;
+}
+
+static void apply(int new_quality, int new_size_idx)
+{
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) return;
+
+    if (new_size_idx != size_idx && s->set_framesize(s, size_ladder[new_size_idx]) != 0) {
+        ESP_LOGW(TAG, "set_framesize %s failed", size_names[new_size_idx]);
+        return;
+    }
+    if (new_quality != quality && s->set_quality(s, new_quality) != 0) {
+        ESP_LOGW(TAG, "set_quality %d failed", new_quality);
+    }
+
+    ESP_LOGI(TAG, "%s q%d -> %s q%d (%lu kbps, %lu ms, %lu%% congested)",
+             size_names[size_idx], quality, size_names[new_size_idx], new_quality,
+             (unsigned long)last_kbps, (unsigned long)last_latency_ms,
+             (unsigned long)last_congested_pct);
+    quality = new_quality;
+    size_idx = new_size_idx;
+}
+
+// One step towards smaller frames: worse quality first, then fewer pixels
+// at the same quality
+static bool step_down(void)
+{
+    if (quality + QCTL_QUALITY_STEP <= QCTL_QUALITY_MAX) {
+        apply(quality + QCTL_QUALITY_STEP, size_idx);
+    } else if (size_idx > 0) {
+        apply(quality, size_idx - 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One step towards larger frames: more pixels if the bitrate scaled by the
+// pixel ratio still fits under the budget, otherwise better quality
+static bool step_up(uint32_t kbps)
+{
+    if (size_idx < SIZE_STEPS - 1) {
+        uint64_t predicted = (uint64_t)kbps * pixels(size_idx + 1) / pixels(size_idx);
+        if (predicted * 100 < (uint64_t)QCTL_TARGET_KBPS * (100 - QCTL_HYSTERESIS_PCT)) {
+            apply(quality, size_idx + 1);
+            return true;
+        }
+    }
+    if (quality - QCTL_QUALITY_STEP >= QCTL_QUALITY_MIN) {
+        apply(quality - QCTL_QUALITY_STEP, size_idx);
+        return true;
+    }
+    return false;
+}
+
+// --- Controller Task ---
+static void quality_ctl_task(void *arg)
+{
+    int over_periods = 0;
+    int under_periods = 0;
+    bool settling = false;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(QCTL_PERIOD_MS));
+
+        uint32_t bytes = atomic_exchange(&period_bytes, 0);
+        uint32_t frames = atomic_exchange(&period_frames, 0);
+        uint32_t sent = atomic_exchange(&sent_count, 0);
+        uint64_t sent_sum = atomic_exchange(&sent_sum_us, 0);
+        uint32_t skipped = atomic_exchange(&skip_count, 0);
+
+        // Congestion is the share of frames due to a viewer that its link
+        // could not take, so one slow viewer weighs as much as its frame rate
+        last_kbps = (uint32_t)((uint64_t)bytes * 8 / QCTL_PERIOD_MS);
+        last_latency_ms = sent ? (uint32_t)(sent_sum / sent / 1000) : 0;
+        last_congested_pct = sent + skipped ? skipped * 100 / (sent + skipped) : 0;
+
+        // The period after a change still holds frames of the old settings
+        if (settling || !frames) {
+            settling = false;
+            continue;
+        }
+
+        const uint32_t h = QCTL_HYSTERESIS_PCT;
+        bool over = last_kbps * 100 > QCTL_TARGET_KBPS * (100 + h) ||
+                    last_latency_ms * 100 > QCTL_TARGET_LATENCY_MS * (100 + h) ||
+                    last_congested_pct * 100 > QCTL_CONGESTED_PCT * (100 + h);
+        bool under = last_kbps * 100 < QCTL_TARGET_KBPS * (100 - h) &&
+                     last_latency_ms * 100 < QCTL_TARGET_LATENCY_MS * (100 - h) &&
+                     last_congested_pct * 100 < QCTL_CONGESTED_PCT * (100 - h);
+
+        over_periods = over ? over_periods + 1 : 0;
+        under_periods = under ? under_periods + 1 : 0;
+
+        // Back off quickly, recover slowly
+        bool changed = false;
+        if (over_periods >= QCTL_HOLD_DOWN) {
+            changed = step_down();
+        } else if (under_periods >= QCTL_HOLD_UP) {
+            changed = step_up(last_kbps);
+        }
+        if (changed) {
+            over_periods = 0;
+            under_periods = 0;
+            settling = true;
+        }
+    }
+}
+
+int quality_ctl_json(char *buf, size_t len)
+{
+    return snprintf(buf, len,
+                    "{\"auto\":%s,\"quality\":%d,\"frame_size\":\"%s\",\"kbps\":%lu,"
+                    "\"latency_ms\":%lu,\"congested_pct\":%lu}",
+                    QCTL_ENABLED ? "true" : "false", quality, size_names[size_idx],
+                    (unsigned long)last_kbps, (unsigned long)last_latency_ms,
+                    (unsigned long)last_congested_pct);
+}
+
+void quality_ctl_init(void)
+{
+    xTaskCreate(quality_ctl_task, "quality_ctl", QCTL_STACK_SIZE, NULL, QCTL_PRIORITY, NULL);
+    ESP_LOGI(TAG, "Target %d kbps, %d ms capture to sent, %d%% congested", QCTL_TARGET_KBPS,
+             QCTL_TARGET_LATENCY_MS, QCTL_CONGESTED_PCT);
+}
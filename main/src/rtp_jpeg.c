@@ -0,0 +1,204 @@
+#include "rtp_jpeg.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define RTP_HDR_LEN         12
+#define JPEG_HDR_LEN        8
+#define RESTART_HDR_LEN     4
+#define QT_HDR_LEN          4
+
+// JPEG markers
+#define M_SOF0  0xC0
+#define M_DHT   0xC4
+#define M_SOI   0xD8
+#define M_EOI   0xD9
+#define M_SOS   0xDA
+#define M_DQT   0xDB
+#define M_DRI   0xDD
+
+static inline uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+    return p + 2;
+}
+
+static inline uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static esp_err_t parse_dqt(const uint8_t *seg, size_t len, rtp_jpeg_info_t *info)
+{
+    while (len > 0) {
+        uint8_t pq = seg[0] >> 4;
+        uint8_t tq = seg[0] & 0x0F;
+        if (pq != 0 || tq > 1) return ESP_ERR_NOT_SUPPORTED;   // 16-bit or extra table
+        if (len < 65) return ESP_ERR_INVALID_SIZE;
+
+        if (!info->qt[tq]) info->nqt++;
+        info->qt[tq] = seg + 1;
+        seg += 65;
+        len -= 65;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sof0(const uint8_t *seg, size_t len, rtp_jpeg_info_t *info)
+{
+    if (len < 6) return ESP_ERR_INVALID_SIZE;
+    uint16_t height = be16(seg + 1);
+    uint16_t width  = be16(seg + 3);
+    uint8_t ncomp   = seg[5];
+
+    if (seg[0] != 8 || ncomp != 3 || len < 6 + 3 * ncomp) return ESP_ERR_NOT_SUPPORTED;
+    if (width == 0 || height == 0 || width > 2040 || height > 2040) return ESP_ERR_NOT_SUPPORTED;
+
+    // Luma sampling picks the type; chroma must be 1x1
+    switch (seg[7]) {
+    case 0x21: info->type = 0; break;
+    case 0x22: info->type = 1; break;
+    default:   return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (seg[10] != 0x11 || seg[13] != 0x11) return ESP_ERR_NOT_SUPPORTED;
+
+    info->width8  = (width + 7) / 8;
+    info->height8 = (height + 7) / 8;
+    return ESP_OK;
+}
+
+esp_err_t rtp_jpeg_parse(const uint8_t *jpg, size_t len, rtp_jpeg_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    if (len < 4 || jpg[0] != 0xFF || jpg[1] != M_SOI) return ESP_ERR_INVALID_ARG;
+
+    bool have_sof = false;
+    size_t pos = 2;
+
+    while (pos + 4 <= len) {
+        if (jpg[pos] != 0xFF) return ESP_ERR_INVALID_ARG;
+        uint8_t marker = jpg[pos + 1];
+        if (marker == 0xFF) {       // fill byte
+            pos++;
+            continue;
+        }
+
+        size_t seg_len = be16(jpg + pos + 2);
+        if (seg_len < 2 || pos + 2 + seg_len > len) return ESP_ERR_INVALID_SIZE;
+        const uint8_t *seg = jpg + pos + 4;
+        size_t body = seg_len - 2;
+        esp_err_t err = ESP_OK;
+
+        switch (marker) {
+        case M_DQT:
+            err = parse_dqt(seg, body, info);
+            break;
+        case M_SOF0:
+            err = parse_sof0(seg, body, info);
+            have_sof = true;
+            break;
+        case M_DRI:
+            if (body < 2) return ESP_ERR_INVALID_SIZE;
+            info->dri = be16(seg);
+            break;
+        case M_SOS: {
+            if (!have_sof || !info->qt[0]) return ESP_ERR_NOT_SUPPORTED;
+            size_t start = pos + 2 + seg_len;
+            size_t end = len;
+            if (end >= start + 2 && jpg[end - 2] == 0xFF && jpg[end - 1] == M_EOI) {
+                end -= 2;
+            }
+            info->scan = jpg + start;
+            info->scan_len = end - start;
+            if (info->dri) info->type += 64;
+            return ESP_OK;
+        }
+        default:
+            // SOF1+ are not baseline; DHT, APPn and COM are implied or irrelevant
+            if (marker > M_SOF0 && marker <= 0xCF && marker != M_DHT && marker != 0xC8 &&
+                marker != 0xCC) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            break;
+        }
+        if (err != ESP_OK) return err;
+        pos += 2 + seg_len;
+    }
+    return ESP_ERR_INVALID_SIZE;    // no SOS
+}
+
+esp_err_t rtp_jpeg_send_frame(rtp_stream_t *rs, const rtp_jpeg_info_t *info, uint32_t ts,
+                              rtp_send_fn send, void *ctx)
+{
+    const size_t qt_len = 64 * info->nqt;
+    size_t off = 0;
+
+    while (off < info->scan_len) {
+        uint8_t hdr[RTP_HDR_LEN + JPEG_HDR_LEN + RESTART_HDR_LEN + QT_HDR_LEN];
+        struct iovec iov[RTP_JPEG_MAX_IOV];
+        int iovcnt = 1;
+
+        // Main JPEG header: Q = 255 means the tables travel in the first packet
+        uint8_t *p = hdr + RTP_HDR_LEN;
+        p = put_be32(p, off & 0x00FFFFFF);  // type-specific 0 | 24-bit offset
+        *p++ = info->type;
+        *p++ = 255;
+        *p++ = info->width8;
+        *p++ = info->height8;
+
+        if (info->type >= 64) {
+            // Packets are not aligned to restart intervals: F = L = 1, count 0x3FFF
+            p = put_be16(p, info->dri);
+            p = put_be16(p, 0xFFFF);
+        }
+
+        size_t room = RTP_JPEG_MAX_PAYLOAD - (p - (hdr + RTP_HDR_LEN));
+        if (off == 0) {
+            *p++ = 0;                       // MBZ
+            *p++ = 0;                       // 8-bit tables
+            p = put_be16(p, qt_len);
+            room -= QT_HDR_LEN + qt_len;
+        }
+
+        size_t chunk = info->scan_len - off;
+        if (chunk > room) chunk = room;
+        bool last = off + chunk == info->scan_len;
+
+        // RTP header
+        hdr[0] = 0x80;                      // V = 2
+        hdr[1] = RTP_PT_JPEG | (last ? 0x80 : 0);
+        put_be16(hdr + 2, rs->seq++);
+        put_be32(hdr + 4, ts);
+        put_be32(hdr + 8, rs->ssrc);
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len  = p - hdr;
+        if (off == 0) {
+            for (int i = 0; i < info->nqt; i++) {
+                iov[iovcnt].iov_base = (void *)info->qt[i];
+                iov[iovcnt].iov_len  = 64;
+                iovcnt++;
+            }
+        }
+        iov[iovcnt].iov_base = (void *)(info->scan + off);
+        iov[iovcnt].iov_len  = chunk;
+        iovcnt++;
+
+        size_t total = 0;
+        for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+
+        esp_err_t err = send(ctx, iov, iovcnt, total);
+        if (err != ESP_OK) return err;
+        off += chunk;
+    }
+    return ESP_OK;
+}
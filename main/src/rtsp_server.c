@@ -0,0 +1,583 @@
+#include "rtsp_server.h"
+#include "rtp_jpeg.h"
+#include "sock_io.h"
+#include "common.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/sockets.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <errno.h>
+
+static const char *TAG = "RTSP";
+
+#define RTSP_STACK_SIZE         4096
+#define RTSP_PRIORITY           4
+#define RTSP_REQ_MAX            1024
+#define RTSP_SESSION_TIMEOUT_S  60
+#define RTSP_SEND_TIMEOUT_MS    2000
+#define RTSP_REPLY_MAX          768
+// Unsent bytes a connection may hold: the rest of one interleaved RTP
+// packet plus one reply queued behind it
+#define RTSP_TX_MAX             (4 + 12 + RTP_JPEG_MAX_PAYLOAD + RTSP_REPLY_MAX)
+
+typedef enum {
+    RTSP_INIT,
+    RTSP_READY,         // SETUP done
+    RTSP_PLAYING,
+} rtsp_state_t;
+
+typedef struct {
+    int fd;                         // RTSP connection, -1 = free
+    rtsp_state_t state;
+    uint32_t session_id;
+    bool tcp;                       // RTP interleaved on fd instead of UDP
+    uint8_t channel;                // interleaved RTP channel
+    int udp_fd;                     // -1 unless UDP transport
+    struct sockaddr_in rtp_dest;
+    rtp_stream_t rtp;
+    int64_t last_seen_us;           // last request, for the UDP session timeout
+    size_t rx_len;
+    char rx_buf[RTSP_REQ_MAX];
+    size_t tx_len;                  // bytes the non-blocking socket has not taken yet
+    int64_t tx_progress_us;         // last time tx_buf shrank or started filling
+    uint8_t tx_buf[RTSP_TX_MAX];
+} rtsp_session_t;
+
+static rtsp_session_t sessions[RTSP_MAX_SESSIONS];
+static int listen_fd = -1;
+static int wake_fd = -1;
+
+// Newest frame not yet sent, handed over by rtsp_publish()
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_ref_t *pending = NULL;
+static atomic_int playing;          // sessions in RTSP_PLAYING
+
+void rtsp_publish(frame_ref_t *ref)
+{
+    if (atomic_load(&playing) == 0) return;
+
+    portENTER_CRITICAL(&pending_lock);
+    frame_ref_t *old = pending;
+    pending = frame_ref_get(ref);
+    portEXIT_CRITICAL(&pending_lock);
+
+    if (old) {
+        drop_count(DROP_CLIENT_CONGESTED, 1);
+        frame_ref_put(old);
+    }
+
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+}
+
+static frame_ref_t *take_pending(void)
+{
+    portENTER_CRITICAL(&pending_lock);
+    frame_ref_t *ref = pending;
+    pending = NULL;
+    portEXIT_CRITICAL(&pending_lock);
+    return ref;
+}
+
+static void session_close(rtsp_session_t *s)
+{
+    if (s->state == RTSP_PLAYING) {
+        atomic_fetch_sub(&playing, 1);
+    }
+    if (s->udp_fd >= 0) {
+        close(s->udp_fd);
+        s->udp_fd = -1;
+    }
+    close(s->fd);
+    s->fd = -1;
+    s->tx_len = 0;
+    s->state = RTSP_INIT;
+    s->session_id = 0;
+    ESP_LOGI(TAG, "Session %d closed", (int)(s - sessions));
+}
+
+// --- Non-blocking writes on the RTSP connection ---
+// Interleaved RTP and replies share the connection, so a packet or reply is
+// either written whole or not started: whatever the socket does not take is
+// kept in tx_buf and goes out ahead of anything else. A session that is still
+// behind skips RTP packets, and one that makes no progress for
+// RTSP_SEND_TIMEOUT_MS is closed, so a slow TCP viewer never holds up rtsp_task.
+
+// Returns ESP_FAIL on a socket error
+static esp_err_t session_flush(rtsp_session_t *s, int64_t now)
+{
+    while (s->tx_len) {
+        ssize_t n = send(s->fd, s->tx_buf, s->tx_len, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return ESP_OK;
+            if (errno == EINTR) continue;
+            return ESP_FAIL;
+        }
+        s->tx_len -= n;
+        memmove(s->tx_buf, s->tx_buf + n, s->tx_len);
+        s->tx_progress_us = now;
+    }
+    return ESP_OK;
+}
+
+// Write one packet or reply. With `queue` false (RTP) it is skipped with
+// ESP_ERR_NO_MEM while earlier bytes are still unsent; replies are queued
+// behind them. ESP_FAIL on a socket error or when the backlog is full.
+static esp_err_t session_send(rtsp_session_t *s, const struct iovec *iov, int iovcnt, bool queue)
+{
+    int64_t now = esp_timer_get_time();
+    if (session_flush(s, now) != ESP_OK) return ESP_FAIL;
+    if (s->tx_len && !queue) return ESP_ERR_NO_MEM;
+
+    size_t total = sock_iov_len(iov, iovcnt);
+    if (s->tx_len + total > sizeof(s->tx_buf)) return ESP_FAIL;
+
+    ssize_t n = 0;
+    if (!s->tx_len) {
+        n = lwip_writev(s->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return ESP_FAIL;
+            n = 0;
+        }
+        if ((size_t)n < total) s->tx_progress_us = now;
+    }
+
+    // Keep the rest
+    for (int i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].iov_len;
+        size_t skip = (size_t)n < len ? (size_t)n : len;
+        memcpy(s->tx_buf + s->tx_len, (const uint8_t *)iov[i].iov_base + skip, len - skip);
+        s->tx_len += len - skip;
+        n -= skip;
+    }
+    return ESP_OK;
+}
+
+// --- RTP transports ---
+static esp_err_t send_udp(void *ctx, const struct iovec *iov, int iovcnt, size_t len)
+{
+    rtsp_session_t *s = ctx;
+    struct msghdr msg = {
+        .msg_name = &s->rtp_dest,
+        .msg_namelen = sizeof(s->rtp_dest),
+        .msg_iov = (struct iovec *)iov,
+        .msg_iovlen = iovcnt,
+    };
+
+    if (sendmsg(s->udp_fd, &msg, 0) < 0) {
+        // lwIP out of buffers: give up on this frame, not the session
+        return (errno == ENOMEM || errno == EAGAIN) ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// RFC 2326 10.12: '$', channel, 16-bit length, then the RTP packet
+static esp_err_t send_tcp(void *ctx, const struct iovec *iov, int iovcnt, size_t len)
+{
+    rtsp_session_t *s = ctx;
+    uint8_t ilv[4] = { '$', s->channel, (uint8_t)(len >> 8), (uint8_t)len };
+    struct iovec v[RTP_JPEG_MAX_IOV + 1];
+
+    v[0].iov_base = ilv;
+    v[0].iov_len = sizeof(ilv);
+    memcpy(&v[1], iov, iovcnt * sizeof(*iov));
+    return session_send(s, v, iovcnt + 1, false);
+}
+
+static void send_frame(frame_ref_t *ref)
+{
+    rtp_jpeg_info_t info;
+    esp_err_t err = rtp_jpeg_parse(ref->fb->buf, ref->fb->len, &info);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Frame %lu not RTP/JPEG compatible (0x%x)", (unsigned long)ref->seq, err);
+        drop_count(DROP_BAD_JPEG, 1);
+        return;
+    }
+
+    uint32_t ts = rtp_jpeg_timestamp(ref->capture_us);
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        rtsp_session_t *s = &sessions[i];
+        if (s->fd < 0 || s->state != RTSP_PLAYING) continue;
+
+        err = rtp_jpeg_send_frame(&s->rtp, &info, ts, s->tcp ? send_tcp : send_udp, s);
+        if (err == ESP_OK) {
+            total_frames_sent++;
+        } else if (err == ESP_ERR_NO_MEM) {
+            // Link behind: the rest of this frame is skipped, the session stays
+            drop_count(DROP_CLIENT_CONGESTED, 1);
+        } else {
+            drop_count(DROP_SEND_FAIL, 1);
+            session_close(s);
+        }
+    }
+}
+
+// --- RTSP requests ---
+static bool rtsp_header(const char *req, const char *name, char *out, size_t len)
+{
+    size_t nlen = strlen(name);
+
+    for (const char *line = strstr(req, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, nlen) == 0 && line[nlen] == ':') {
+            const char *v = line + nlen + 1;
+            while (*v == ' ') v++;
+            size_t n = strcspn(v, "\r\n");
+            if (n >= len) n = len - 1;
+            memcpy(out, v, n);
+            out[n] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+static void rtsp_reply(rtsp_session_t *s, int cseq, const char *status,
+                       const char *headers, const char *body)
+{
+    char buf[RTSP_REPLY_MAX];
+    int n = snprintf(buf, sizeof(buf), "RTSP/1.0 %s\r\nCSeq: %d\r\n%s",
+                     status, cseq, headers ? headers : "");
+    if (s->session_id && n < (int)sizeof(buf)) {
+        n += snprintf(buf + n, sizeof(buf) - n, "Session: %08lX;timeout=%d\r\n",
+                      (unsigned long)s->session_id, RTSP_SESSION_TIMEOUT_S);
+    }
+    if (n < (int)sizeof(buf)) {
+        n += snprintf(buf + n, sizeof(buf) - n, "Content-Length: %u\r\n\r\n%s",
+                      body ? (unsigned)strlen(body) : 0, body ? body : "");
+    }
+    if (n >= (int)sizeof(buf)) {
+        ESP_LOGE(TAG, "Reply too long");
+        return;
+    }
+
+    struct iovec iov = { .iov_base = buf, .iov_len = n };
+    if (session_send(s, &iov, 1, true) != ESP_OK) {
+        ESP_LOGW(TAG, "Session %d: reply not sent", (int)(s - sessions));
+        session_close(s);   // the client would wait for it forever
+    }
+}
+
+static void handle_describe(rtsp_session_t *s, int cseq, const char *url)
+{
+    struct sockaddr_in local;
+    socklen_t alen = sizeof(local);
+    getsockname(s->fd, (struct sockaddr *)&local, &alen);
+
+    char sdp[256];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\n"
+             "o=- %lu 1 IN IP4 %s\r\n"
+             "s=ESP32-CAM\r\n"
+             "c=IN IP4 0.0.0.0\r\n"
+             "t=0 0\r\n"
+             "m=video 0 RTP/AVP %d\r\n"
+             "a=control:track1\r\n",
+             (unsigned long)esp_random(), inet_ntoa(local.sin_addr), RTP_PT_JPEG);
+
+    char headers[320];
+    size_t ulen = strlen(url);
+    snprintf(headers, sizeof(headers),
+             "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n",
+             url, ulen && url[ulen - 1] == '/' ? "" : "/");
+    rtsp_reply(s, cseq, "200 OK", headers, sdp);
+}
+
+static void handle_setup(rtsp_session_t *s, int cseq, const char *req)
+{
+    char transport[128];
+    char headers[192];
+    int a, b;
+
+    if (!rtsp_header(req, "Transport", transport, sizeof(transport))) {
+        rtsp_reply(s, cseq, "400 Bad Request", NULL, NULL);
+        return;
+    }
+    if (s->state == RTSP_PLAYING) {
+        rtsp_reply(s, cseq, "455 Method Not Valid in This State", NULL, NULL);
+        return;
+    }
+    if (s->udp_fd >= 0) {
+        close(s->udp_fd);
+        s->udp_fd = -1;
+    }
+
+    uint32_t ssrc = esp_random();
+    const char *p;
+
+    if (strstr(transport, "RTP/AVP/TCP")) {
+        a = 0;
+        b = 1;
+        if ((p = strstr(transport, "interleaved=")) != NULL) {
+            sscanf(p, "interleaved=%d-%d", &a, &b);
+        }
+        s->tcp = true;
+        s->channel = (uint8_t)a;
+        snprintf(headers, sizeof(headers),
+                 "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08lX\r\n",
+                 a, a + 1, (unsigned long)ssrc);
+    } else if ((p = strstr(transport, "client_port=")) != NULL &&
+               !strstr(transport, "multicast") &&
+               sscanf(p, "client_port=%d-%d", &a, &b) >= 1) {
+        struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+        socklen_t alen = sizeof(local);
+        s->udp_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (s->udp_fd < 0 || bind(s->udp_fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+            rtsp_reply(s, cseq, "500 Internal Server Error", NULL, NULL);
+            return;
+        }
+        getsockname(s->udp_fd, (struct sockaddr *)&local, &alen);
+
+        // RTP goes to the address the RTSP connection came from
+        alen = sizeof(s->rtp_dest);
+        getpeername(s->fd, (struct sockaddr *)&s->rtp_dest, &alen);
+        s->rtp_dest.sin_port = htons(a);
+        s->tcp = false;
+
+        int sport = ntohs(local.sin_port);
+        snprintf(headers, sizeof(headers),
+                 "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08lX\r\n",
+                 a, a + 1, sport, sport + 1, (unsigned long)ssrc);
+    } else {
+        rtsp_reply(s, cseq, "461 Unsupported Transport", NULL, NULL);
+        return;
+    }
+
+    s->rtp.ssrc = ssrc;
+    s->rtp.seq = (uint16_t)esp_random();
+    if (!s->session_id) s->session_id = esp_random() | 1;
+    s->state = RTSP_READY;
+    rtsp_reply(s, cseq, "200 OK", headers, NULL);
+}
+
+static void session_request(rtsp_session_t *s, const char *req)
+{
+    char method[16];
+    char url[128];
+    char value[16];
+    int cseq = 0;
+
+    if (sscanf(req, "%15s %127s", method, url) != 2) {
+        rtsp_reply(s, 0, "400 Bad Request", NULL, NULL);
+        return;
+    }
+    if (rtsp_header(req, "CSeq", value, sizeof(value))) {
+        cseq = atoi(value);
+    }
+    s->last_seen_us = esp_timer_get_time();
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        rtsp_reply(s, cseq, "200 OK",
+                   "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    } else if (strcmp(method, "DESCRIBE") == 0) {
+        handle_describe(s, cseq, url);
+    } else if (strcmp(method, "SETUP") == 0) {
+        handle_setup(s, cseq, req);
+    } else if (strcmp(method, "PLAY") == 0) {
+        if (s->state == RTSP_INIT) {
+            rtsp_reply(s, cseq, "455 Method Not Valid in This State", NULL, NULL);
+            return;
+        }
+        if (s->state != RTSP_PLAYING) {
+            s->state = RTSP_PLAYING;
+            atomic_fetch_add(&playing, 1);
+            ESP_LOGI(TAG, "Session %d playing over %s", (int)(s - sessions), s->tcp ? "TCP" : "UDP");
+        }
+        rtsp_reply(s, cseq, "200 OK", "Range: npt=0.000-\r\n", NULL);
+    } else if (strcmp(method, "TEARDOWN") == 0) {
+        rtsp_reply(s, cseq, "200 OK", NULL, NULL);
+        if (s->fd >= 0) session_close(s);
+    } else if (strcmp(method, "GET_PARAMETER") == 0) {
+        rtsp_reply(s, cseq, "200 OK", NULL, NULL);   // keep-alive
+    } else {
+        rtsp_reply(s, cseq, "501 Not Implemented", NULL, NULL);
+    }
+}
+
+// Read what arrived on the RTSP connection and run every complete request.
+// Interleaved packets from the client (RTCP receiver reports) are skipped.
+static void session_read(rtsp_session_t *s)
+{
+    ssize_t n = recv(s->fd, s->rx_buf + s->rx_len, sizeof(s->rx_buf) - 1 - s->rx_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        session_close(s);
+        return;
+    }
+    if (n < 0) return;
+    s->rx_len += n;
+
+    while (s->fd >= 0 && s->rx_len > 0) {
+        size_t used;
+
+        if (s->rx_buf[0] == '$') {
+            if (s->rx_len < 4) break;
+            used = 4 + ((uint8_t)s->rx_buf[2] << 8 | (uint8_t)s->rx_buf[3]);
+            if (used > sizeof(s->rx_buf) - 1) {
+                session_close(s);
+                return;
+            }
+            if (s->rx_len < used) break;
+        } else {
+            s->rx_buf[s->rx_len] = '\0';
+            char *end = strstr(s->rx_buf, "\r\n\r\n");
+            if (!end) {
+                if (s->rx_len == sizeof(s->rx_buf) - 1) session_close(s);
+                break;
+            }
+            end[2] = '\0';      // request = headers up to the last CRLF
+
+            char value[12];
+            size_t body = 0;
+            if (rtsp_header(s->rx_buf, "Content-Length", value, sizeof(value))) {
+                body = strtoul(value, NULL, 10);
+            }
+            used = (end + 4 - s->rx_buf) + body;
+            if (used > sizeof(s->rx_buf) - 1) {
+                session_close(s);
+                return;
+            }
+            if (s->rx_len < used) {
+                end[2] = '\r';
+                break;
+            }
+            session_request(s, s->rx_buf);
+            if (s->fd < 0) return;
+        }
+
+        s->rx_len -= used;
+        memmove(s->rx_buf, s->rx_buf + used, s->rx_len);
+    }
+}
+
+static void session_accept(void)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        rtsp_session_t *s = &sessions[i];
+        if (s->fd < 0) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            s->fd = fd;
+            s->udp_fd = -1;
+            s->state = RTSP_INIT;
+            s->session_id = 0;
+            s->rx_len = 0;
+            s->tx_len = 0;
+            s->last_seen_us = esp_timer_get_time();
+            ESP_LOGI(TAG, "Session %d connected", i);
+            return;
+        }
+    }
+
+    ESP_LOGW(TAG, "Rejecting RTSP client, all %d sessions busy", RTSP_MAX_SESSIONS);
+    const char *busy = "RTSP/1.0 453 Not Enough Bandwidth\r\n\r\n";
+    send(fd, busy, strlen(busy), 0);
+    close(fd);
+}
+
+// --- RTSP Task ---
+// Serves RTSP requests and sends each published frame to every playing
+// session. Sleeps in select() on the listener, the sessions (also for
+// writability while they have unsent bytes) and an eventfd written by
+// rtsp_publish().
+static void rtsp_task(void *arg)
+{
+    while (1) {
+        fd_set rfds, wfds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(listen_fd, &rfds);
+        FD_SET(wake_fd, &rfds);
+        int maxfd = listen_fd > wake_fd ? listen_fd : wake_fd;
+
+        for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+            if (sessions[i].fd < 0) continue;
+            FD_SET(sessions[i].fd, &rfds);
+            if (sessions[i].tx_len) FD_SET(sessions[i].fd, &wfds);
+            if (sessions[i].fd > maxfd) maxfd = sessions[i].fd;
+        }
+
+        struct timeval tv = { .tv_sec = 1 };
+        if (select(maxfd + 1, &rfds, &wfds, NULL, &tv) <= 0) {
+            FD_ZERO(&rfds);
+            FD_ZERO(&wfds);
+        }
+
+        if (FD_ISSET(wake_fd, &rfds)) {
+            uint64_t cnt;
+            read(wake_fd, &cnt, sizeof(cnt));
+        }
+        frame_ref_t *ref = take_pending();
+        if (ref) {
+            send_frame(ref);
+            frame_ref_put(ref);
+        }
+
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+            rtsp_session_t *s = &sessions[i];
+            if (s->fd >= 0 && FD_ISSET(s->fd, &wfds) && session_flush(s, now) != ESP_OK) {
+                session_close(s);
+            }
+            if (s->fd >= 0 && s->tx_len &&
+                now - s->tx_progress_us > (int64_t)RTSP_SEND_TIMEOUT_MS * 1000) {
+                ESP_LOGW(TAG, "Session %d stalled", i);
+                session_close(s);
+            }
+            if (s->fd >= 0 && FD_ISSET(s->fd, &rfds)) {
+                session_read(s);
+            }
+            // UDP viewers that stopped sending keep-alives are gone
+            if (s->fd >= 0 && !s->tcp && s->state != RTSP_INIT &&
+                now - s->last_seen_us > (int64_t)RTSP_SESSION_TIMEOUT_S * 1000000) {
+                ESP_LOGW(TAG, "Session %d timed out", i);
+                session_close(s);
+            }
+        }
+
+        if (FD_ISSET(listen_fd, &rfds)) {
+            session_accept();
+        }
+    }
+}
+
+esp_err_t rtsp_server_start(void)
+{
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        sessions[i].fd = -1;
+        sessions[i].udp_fd = -1;
+    }
+
+    wake_fd = eventfd(0, 0);
+    listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (wake_fd < 0 || listen_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create sockets");
+        return ESP_FAIL;
+    }
+
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RTSP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 2) < 0) {
+        ESP_LOGE(TAG, "Port %d unavailable", RTSP_PORT);
+        close(listen_fd);
+        listen_fd = -1;
+        return ESP_FAIL;
+    }
+
+    xTaskCreate(rtsp_task, "rtsp_server", RTSP_STACK_SIZE, NULL, RTSP_PRIORITY, NULL);
+    ESP_LOGI(TAG, "RTSP server on port %d", RTSP_PORT);
+    return ESP_OK;
+}
@@ -0,0 +1,86 @@
+#include "sock_io.h"
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include <errno.h>
+
+int sock_iov_advance(struct iovec *iov, int iovcnt, size_t n)
+{
+    int i = 0;
+    while (i < iovcnt && n >= iov[i].iov_len) {
+        n -= iov[i].iov_len;
+        iov[i].iov_len = 0;
+        i++;
+    }
+    if (i < iovcnt) {
+        iov[i].iov_base = (char *)iov[i].iov_base + n;
+        iov[i].iov_len -= n;
+    }
+    return i;
+}
+
+int sock_iov_clamp(const struct iovec *iov, int iovcnt, size_t max, struct iovec *out)
+{
+    int i = 0;
+    while (i < iovcnt && max > 0) {
+        out[i] = iov[i];
+        if (out[i].iov_len > max) out[i].iov_len = max;
+        max -= out[i].iov_len;
+        i++;
+    }
+    return i;
+}
+
+size_t sock_iov_len(const struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+static esp_err_t wait_writable(int fd, int64_t deadline_us)
+{
+    int64_t left_us = deadline_us - esp_timer_get_time();
+    if (left_us <= 0) return ESP_ERR_TIMEOUT;
+
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = {
+        .tv_sec  = left_us / 1000000,
+        .tv_usec = left_us % 1000000,
+    };
+
+    int r = select(fd + 1, NULL, &wfds, NULL, &tv);
+    if (r > 0) return ESP_OK;
+    if (r == 0) return ESP_ERR_TIMEOUT;
+    return errno == EINTR ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sock_writev_all(int fd, struct iovec *iov, int iovcnt, int timeout_ms)
+{
+    const int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int first = 0;
+
+    while (first < iovcnt) {
+        // Drop entries that are already empty so writev never sees them
+        if (iov[first].iov_len == 0) {
+            first++;
+            continue;
+        }
+
+        ssize_t n = lwip_writev(fd, &iov[first], iovcnt - first);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                esp_err_t err = wait_writable(fd, deadline_us);
+                if (err != ESP_OK) return err;
+                continue;
+            }
+            return ESP_FAIL;
+        }
+
+        first += sock_iov_advance(&iov[first], iovcnt - first, n);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,1005 @@
+#include "stream.h"
+#include "common.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/sockets.h"
+#include "latency_hist.h"
+#include "sock_io.h"
+#include "rtsp_server.h"
+#include "mcast_stream.h"
+#include "transcode.h"
+#include "frame_poll.h"
+#include "quality_ctl.h"
+#include "face_task.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+static const char *TAG = "STREAM";
+
+#define ENGINE_STACK_SIZE   4096
+#define ENGINE_PRIORITY     4
+#define SEND_TIMEOUT_MS     5000
+
+// Bytes lwIP may still hold after writev() returns: the TCP send buffer
+#ifdef CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#define SOCK_SNDBUF_BYTES   CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#else
+#define SOCK_SNDBUF_BYTES   5760
+#endif
+// Sends shorter than this fit in the send buffer and say nothing about the link
+#define RATE_MIN_SAMPLE_US  2000
+
+// The response is written straight to the socket: no chunked framing,
+// the body ends when the connection closes.
+static const char* _STREAM_HTTP_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=frame\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
+// Seq, capture and send time (esp_timer microseconds) let viewers measure
+// latency and spot gaps without decoding the JPEG
+static const char* _STREAM_PART =
+    "Content-Type: image/jpeg\r\nContent-Length: %u\r\n"
+    "X-Frame-Seq: %lu\r\nX-Capture-Us: %lld\r\nX-Send-Us: %lld\r\n\r\n";
+
+// Guards connected/req/fd/pending of every slot. A slot is live once fd >= 0.
+static portMUX_TYPE clients_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Newest published frame for /capture, one reference owned here.
+// Guarded by clients_lock.
+static frame_ref_t *latest_frame = NULL;
+
+// Driver buffers viewers have in flight, engine only. Capped at VIEWER_FB_MAX
+// so lagging sends cannot hold every buffer and stall esp_camera_fb_get().
+static int viewer_fbs = 0;
+
+// eventfd the engine selects on next to the client sockets; written on
+// every publish so the engine sleeps until there is something to send
+static int wake_fd = -1;
+
+// --- Legacy stream port ---
+// Viewers configured for the old dedicated stream server (:81/stream) are
+// accepted by the engine itself, so no second httpd instance is needed.
+#define LEGACY_REQ_MAX      256
+#define LEGACY_REQ_TIMEOUT_MS 3000
+
+typedef struct {
+    int fd;                     // -1 = unused
+    int64_t deadline_us;
+    size_t len;
+    char buf[LEGACY_REQ_MAX];
+} legacy_conn_t;
+
+static int legacy_listen_fd = -1;
+static legacy_conn_t legacy_conns[MAX_STREAM_CLIENTS];
+
+static const char* _LEGACY_NOT_FOUND =
+    "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n"
+    "Only /stream is served on this port\r\n";
+static const char* _LEGACY_BUSY =
+    "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n"
+    "Too many viewers\r\n";
+
+// --- Bandwidth shaper ---
+// Settings are word-sized and read by the engine without a lock; a change
+// takes effect from the next engine pass.
+static volatile stream_shaper_t shaper = {
+    .enabled = SHAPER_ENABLED,
+    .client_Bps = SHAPER_CLIENT_BPS,
+    .total_Bps = SHAPER_TOTAL_BPS,
+};
+static token_bucket_t total_bucket;     // shared by all viewers, engine only
+
+static void engine_wake(void)
+{
+    uint64_t one = 1;
+    if (wake_fd >= 0) {
+        write(wake_fd, &one, sizeof(one));
+    }
+}
+
+static void client_release_inflight(mjpeg_client_t *c)
+{
+    if (c->inflight_fb) viewer_fbs--;
+    c->inflight_fb = false;
+    frame_ref_put(c->inflight);
+    c->inflight = NULL;
+}
+
+// --- Release a client slot and give the socket back to httpd ---
+static void client_detach(mjpeg_client_t *c)
+{
+    portENTER_CRITICAL(&clients_lock);
+    httpd_req_t *req = c->req;
+    int fd = c->fd;
+    frame_ref_t *pending = c->pending;
+    c->connected = 0;
+    c->req = NULL;
+    c->fd = -1;
+    c->pending = NULL;
+    portEXIT_CRITICAL(&clients_lock);
+
+    frame_ref_put(pending);
+    client_release_inflight(c);
+    transcode_profile_release(c->profile);
+    c->profile = 0;
+
+    if (req) {
+        httpd_handle_t hd = req->handle;
+        httpd_req_async_handler_complete(req);
+        httpd_sess_trigger_close(hd, fd);
+    } else if (fd >= 0) {
+        close(fd);      // legacy-port viewer, not an httpd session
+    }
+}
+
+static void client_unreserve(mjpeg_client_t *slot)
+{
+    transcode_profile_release(slot->profile);
+    slot->profile = 0;
+
+    portENTER_CRITICAL(&clients_lock);
+    slot->connected = 0;
+    portEXIT_CRITICAL(&clients_lock);
+}
+
+// Claim a free slot and, for a downscaled stream, a transcode profile. The
+// slot stays invisible to the engine until client_activate().
+static mjpeg_client_t *client_reserve(const stream_opts_t *opts)
+{
+    mjpeg_client_t *slot = NULL;
+
+    portENTER_CRITICAL(&clients_lock);
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!mjpeg_clients[i].connected) {
+            slot = &mjpeg_clients[i];
+            slot->connected = 1;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&clients_lock);
+    if (!slot) return NULL;
+
+    slot->profile = 0;
+    slot->scale = 1;
+    if (opts->scale > 1) {
+        int id = transcode_profile_acquire(opts->scale, opts->quality);
+        if (id < 0) {
+            ESP_LOGW(TAG, "All %d transcode profiles busy", TRANSCODE_MAX_PROFILES);
+            client_unreserve(slot);
+            return NULL;
+        }
+        slot->profile = id;
+        slot->scale = opts->scale;
+    }
+    return slot;
+}
+
+// Hand the socket to the engine. The MJPEG response header is queued as the
+// first write and flushed by the engine like a frame (httpd already answered
+// a WebSocket handshake), so neither the engine nor the httpd task waits on
+// a peer that does not read.
+static void client_activate(mjpeg_client_t *slot, int fd, httpd_req_t *req,
+                            stream_kind_t kind, const stream_opts_t *opts)
+{
+    // From here on only the engine writes, and it never blocks
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    slot->kind = kind;
+    slot->inflight = NULL;
+    slot->inflight_fb = false;
+    slot->iov_first = 0;
+    slot->iov_cnt = 0;
+    if (kind == STREAM_MJPEG) {
+        slot->iov[0].iov_base = (void *)_STREAM_HTTP_HEADER;
+        slot->iov[0].iov_len  = strlen(_STREAM_HTTP_HEADER);
+        slot->iov_cnt = 1;
+    }
+    slot->last_progress_us = esp_timer_get_time();
+    slot->min_interval_us = 1000000 / opts->fps;
+    slot->rate_slot_us = 0;
+    slot->rate_Bps = 0;
+    slot->send_us = 0;
+    slot->next_due_us = 0;
+    slot->rate_due_us = 0;
+    slot->congested = false;
+    tb_init(&slot->bucket, 0, SHAPER_BURST_BYTES, esp_timer_get_time());
+    slot->shape_due_us = 0;
+    slot->shaped = false;
+    slot->shape_since_us = 0;
+    slot->shape_held_us = 0;
+    slot->rx_len = 0;
+    slot->acks = false;
+    slot->unacked_cnt = 0;
+
+    portENTER_CRITICAL(&clients_lock);
+    slot->req = req;
+    slot->fd = fd;
+    portEXIT_CRITICAL(&clients_lock);
+
+    engine_wake();      // flush the header without waiting for a frame
+
+    ESP_LOGI(TAG, "Client %d connected (%s, %lu fps, 1/%d scale)", (int)(slot - mjpeg_clients),
+             kind == STREAM_WS ? "ws" : "mjpeg", (unsigned long)opts->fps, slot->scale);
+}
+
+// A frame or the response header is still being written
+static inline bool client_busy(const mjpeg_client_t *c)
+{
+    return c->iov_first < c->iov_cnt;
+}
+
+static inline uint32_t ewma(uint32_t avg, uint32_t sample)
+{
+    return avg ? avg - avg / 4 + sample / 4 : sample;
+}
+
+// A frame replaced in `pending` at or after this time was due by the frame
+// rate and only held back by the link: stream_publish() reads it to tell
+// congestion skips from rate decimation
+static void client_set_rate_due(mjpeg_client_t *c, int64_t due_us)
+{
+    portENTER_CRITICAL(&clients_lock);
+    c->rate_due_us = due_us;
+    portEXIT_CRITICAL(&clients_lock);
+}
+
+// --- Congestion-aware pacing ---
+// writev() stops accepting data once only the send buffer is left queued, so
+// the send time tracks this client's link rate. The next frame is held back
+// until the remaining send buffer should have drained (and the frame interval
+// has passed), so it enters an empty queue instead of piling up behind the last one.
+//
+// The frame interval runs on its own schedule of slots rather than from the
+// last send: a frame that waited for the capture does not push every later
+// slot back, so a 2 fps viewer really gets 2 fps out of a 20 fps capture.
+// Skipped frames are never sent, so decimation saves the airtime.
+static void client_update_pacing(mjpeg_client_t *c, size_t bytes, int64_t t0, int64_t t1)
+{
+    uint32_t send_us = (uint32_t)(t1 - t0);
+    c->send_us = ewma(c->send_us, send_us);
+
+    // A frame the shaper held back measured the shaper, not the link
+    if (send_us >= RATE_MIN_SAMPLE_US && !c->shaped) {
+        c->rate_Bps = ewma(c->rate_Bps, (uint32_t)((uint64_t)bytes * 1000000 / send_us));
+    }
+
+    int64_t drain_us = c->rate_Bps ? (int64_t)SOCK_SNDBUF_BYTES * 1000000 / c->rate_Bps : 0;
+    c->rate_slot_us += c->min_interval_us;
+    if (c->rate_slot_us + c->min_interval_us <= t0) {
+        c->rate_slot_us = t0;   // first frame, or fell a whole slot behind: restart
+    }
+    int64_t due_rate = c->rate_slot_us + c->min_interval_us;
+    int64_t due_link = t1 + drain_us;
+
+    c->congested = due_link > due_rate;
+    c->next_due_us = c->congested ? due_link : due_rate;
+    client_set_rate_due(c, due_rate);
+}
+
+// --- Shaping ---
+// The per-client bucket rate is chosen per frame: just fast enough to finish
+// within SHAPER_SPREAD_PCT of the frame interval, capped by client_Bps. The
+// global bucket caps all viewers together. Writes are cut to what both
+// buckets allow, so lwIP never gets more than a burst ahead of the schedule.
+static void shaper_start_frame(mjpeg_client_t *c, size_t bytes, int64_t now)
+{
+    uint64_t span_us = (uint64_t)c->min_interval_us * SHAPER_SPREAD_PCT / 100;
+    uint32_t rate = span_us ? (uint32_t)((uint64_t)bytes * 1000000 / span_us) : 0;
+    if (rate < SHAPER_BURST_BYTES) rate = SHAPER_BURST_BYTES;     // a chunk a second at least
+    if (shaper.client_Bps && rate > shaper.client_Bps) rate = shaper.client_Bps;
+
+    tb_set_rate(&c->bucket, rate, now);
+    c->shaped = false;
+}
+
+// Time spent held back on purpose is not link latency
+static void shaper_hold_end(mjpeg_client_t *c, int64_t now)
+{
+    if (c->shape_since_us) {
+        c->shape_held_us += now - c->shape_since_us;
+        c->shape_since_us = 0;
+    }
+}
+
+// Bytes this client may write now, SIZE_MAX when unshaped. Returns 0 and sets
+// shape_due_us when it has to wait for a whole chunk.
+static size_t shaper_allow(mjpeg_client_t *c, int64_t now)
+{
+    c->shape_due_us = 0;
+    if (!shaper.enabled) return SIZE_MAX;
+
+    size_t want = sock_iov_len(&c->iov[c->iov_first], c->iov_cnt - c->iov_first);
+    if (want > SHAPER_BURST_BYTES) want = SHAPER_BURST_BYTES;
+
+    size_t allow = tb_available(&c->bucket, now);
+    size_t total = tb_available(&total_bucket, now);
+    if (total < allow) allow = total;
+    if (allow >= want) {
+        shaper_hold_end(c, now);
+        return allow;
+    }
+
+    // Wait for a full chunk rather than trickle out tiny segments
+    int64_t wait_us = tb_wait_us(&c->bucket, want);
+    int64_t total_wait_us = tb_wait_us(&total_bucket, want);
+    if (total_wait_us > wait_us) wait_us = total_wait_us;
+
+    c->shaped = true;
+    if (!c->shape_since_us) c->shape_since_us = now;
+    c->shape_due_us = now + (wait_us > 0 ? wait_us : 1);
+    c->last_progress_us = now;      // waiting on purpose is not a stall
+    return 0;
+}
+
+// --- WebSocket framing ---
+// Server-to-client frames are unmasked: FIN + binary opcode, then the payload
+// length in the shortest encoding. Returns the header size.
+static int ws_frame_header(uint8_t *out, uint64_t len)
+{
+    int n = 0;
+    out[n++] = 0x80 | HTTPD_WS_TYPE_BINARY;
+    if (len < 126) {
+        out[n++] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        out[n++] = 126;
+        out[n++] = (uint8_t)(len >> 8);
+        out[n++] = (uint8_t)len;
+    } else {
+        out[n++] = 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out[n++] = (uint8_t)(len >> shift);
+        }
+    }
+    return n;
+}
+
+// Frames may go out while fewer than WS_ACK_WINDOW are unacknowledged.
+// Counted in frames sent, not seq distance: seqs skip on fps decimation,
+// ring overwrites and replaced pending frames.
+static bool client_window_open(const mjpeg_client_t *c)
+{
+    return !c->acks || c->unacked_cnt < WS_ACK_WINDOW;
+}
+
+static void client_track_sent(mjpeg_client_t *c, uint32_t seq)
+{
+    // Before the first ack nothing is gated; keep only the newest seqs
+    if (c->unacked_cnt == WS_ACK_WINDOW) {
+        memmove(&c->unacked[0], &c->unacked[1], (WS_ACK_WINDOW - 1) * sizeof(c->unacked[0]));
+        c->unacked_cnt--;
+    }
+    c->unacked[c->unacked_cnt++] = seq;
+}
+
+// An ack covers its frame and every frame sent before it
+static void client_track_ack(mjpeg_client_t *c, uint32_t seq)
+{
+    int keep = 0;
+    for (int i = 0; i < c->unacked_cnt; i++) {
+        if (frame_seq_after(c->unacked[i], seq)) {
+            c->unacked[keep++] = c->unacked[i];
+        }
+    }
+    c->unacked_cnt = keep;
+}
+
+static void ws_client_command(mjpeg_client_t *c, const uint8_t *payload, size_t len)
+{
+    char cmd[32];
+    unsigned long v;
+
+    if (len >= sizeof(cmd)) return;
+    memcpy(cmd, payload, len);
+    cmd[len] = '\0';
+
+    if (sscanf(cmd, "ack %lu", &v) == 1) {
+        client_track_ack(c, (uint32_t)v);
+        c->acks = true;
+    } else if (sscanf(cmd, "fps %lu", &v) == 1 && v >= 1 && v <= STREAM_MAX_FPS) {
+        c->min_interval_us = 1000000 / v;
+    } else {
+        ESP_LOGW(TAG, "Client %d: unknown command '%s'", (int)(c - mjpeg_clients), cmd);
+    }
+}
+
+// Read upstream messages without blocking. Client frames are masked and, for
+// this protocol, small enough to fit rx_buf whole.
+// Returns ESP_FAIL when the client closed or broke the protocol.
+static esp_err_t ws_client_read(mjpeg_client_t *c)
+{
+    ssize_t n = recv(c->fd, c->rx_buf + c->rx_len, sizeof(c->rx_buf) - c->rx_len, 0);
+    if (n == 0) return ESP_FAIL;
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? ESP_OK : ESP_FAIL;
+    }
+    c->rx_len += n;
+
+    while (c->rx_len >= 2) {
+        uint8_t *b = c->rx_buf;
+        uint8_t opcode = b[0] & 0x0F;
+        size_t len = b[1] & 0x7F;
+        size_t hlen = 2;
+
+        if (!(b[1] & 0x80) || len == 127) return ESP_FAIL;
+        if (len == 126) {
+            if (c->rx_len < 4) break;
+            len = ((size_t)b[2] << 8) | b[3];
+            hlen = 4;
+        }
+        hlen += 4;      // masking key
+        if (hlen + len > sizeof(c->rx_buf)) return ESP_FAIL;
+        if (c->rx_len < hlen + len) break;
+
+        uint8_t *key = b + hlen - 4;
+        uint8_t *payload = b + hlen;
+        for (size_t i = 0; i < len; i++) {
+            payload[i] ^= key[i & 3];
+        }
+
+        if (opcode == HTTPD_WS_TYPE_CLOSE) return ESP_FAIL;
+        if (opcode == HTTPD_WS_TYPE_TEXT) {
+            ws_client_command(c, payload, len);
+        }
+        // Browsers do not ping; binary and pong messages carry nothing for us
+
+        c->rx_len -= hlen + len;
+        memmove(b, b + hlen + len, c->rx_len);
+    }
+    return ESP_OK;
+}
+
+// Move the pending frame in flight. MJPEG: boundary, part header and JPEG;
+// WebSocket: frame header with ws_frame_hdr_t, then the JPEG. Either way the
+// frame is written as one vector.
+static void client_start_frame(mjpeg_client_t *c, int64_t now)
+{
+    portENTER_CRITICAL(&clients_lock);
+    frame_ref_t *ref = c->pending;
+    c->pending = NULL;
+    portEXIT_CRITICAL(&clients_lock);
+
+    if (!ref) return;
+
+    // Over the cap the send goes out of a PSRAM copy and the driver buffer
+    // returns to the camera right away
+    c->inflight_fb = false;
+    if (!ref->heap && viewer_fbs >= VIEWER_FB_MAX) {
+        frame_ref_t *copy = frame_ref_copy(ref);
+        frame_ref_put(ref);
+        if (!copy) {
+            drop_count(DROP_CLIENT_NO_MEM, 1);
+            return;
+        }
+        ref = copy;
+    } else if (!ref->heap) {
+        c->inflight_fb = true;
+        viewer_fbs++;
+    }
+
+    const camera_fb_t *fb = ref->fb;
+    if (c->kind == STREAM_WS) {
+        ws_frame_hdr_t hdr = {
+            .seq = ref->seq,
+            .size = fb->len,
+            .capture_us = ref->capture_us,
+        };
+        int hlen = ws_frame_header((uint8_t *)c->part_buf, sizeof(hdr) + fb->len);
+        memcpy(c->part_buf + hlen, &hdr, sizeof(hdr));
+
+        c->iov[0].iov_base = c->part_buf;
+        c->iov[0].iov_len  = hlen + sizeof(hdr);
+        c->iov[1].iov_base = fb->buf;
+        c->iov[1].iov_len  = fb->len;
+        c->iov_cnt = 2;
+        client_track_sent(c, ref->seq);
+    } else {
+        int hlen = snprintf(c->part_buf, sizeof(c->part_buf), _STREAM_PART, fb->len,
+                            (unsigned long)ref->seq, (long long)ref->capture_us,
+                            (long long)now);
+
+        c->iov[0].iov_base = (void *)_STREAM_BOUNDARY;
+        c->iov[0].iov_len  = strlen(_STREAM_BOUNDARY);
+        c->iov[1].iov_base = c->part_buf;
+        c->iov[1].iov_len  = hlen;
+        c->iov[2].iov_base = fb->buf;
+        c->iov[2].iov_len  = fb->len;
+        c->iov_cnt = 3;
+    }
+    c->iov_first = 0;
+
+    if (shaper.enabled) {
+        shaper_start_frame(c, sock_iov_len(c->iov, c->iov_cnt), now);
+    }
+
+    c->inflight = ref;
+    c->send_start_us = now;
+    c->last_progress_us = now;
+    c->shape_since_us = 0;
+    c->shape_held_us = 0;
+    // Frames arriving within one interval of this send are rate skips, even
+    // while the shaper spreads it out; after that the link is behind
+    client_set_rate_due(c, now + c->min_interval_us);
+}
+
+static void client_finish_frame(mjpeg_client_t *c, int64_t now)
+{
+    frame_ref_t *ref = c->inflight;
+
+    client_update_pacing(c, ref->fb->len, c->send_start_us, now);
+    latency_record(LAT_SEND, now - c->send_start_us);
+    latency_record(LAT_CAPTURE_TO_SENT, now - ref->capture_us);
+    if (c->profile == 0) {
+        shaper_hold_end(c, now);
+        quality_ctl_sent(now - ref->capture_us - c->shape_held_us);
+    }
+    client_release_inflight(c);
+
+    total_frames_sent++;
+}
+
+// Write as much of the in-flight frame (or response header) as the socket
+// takes without blocking. Returns ESP_FAIL when the client has to be dropped.
+static esp_err_t client_pump(mjpeg_client_t *c, int64_t now)
+{
+    while (client_busy(c)) {
+        size_t allow = c->inflight ? shaper_allow(c, now) : SIZE_MAX;
+        if (allow == 0) break;      // resumed by the engine at shape_due_us
+
+        struct iovec clamped[3];
+        const struct iovec *iov = &c->iov[c->iov_first];
+        int cnt = c->iov_cnt - c->iov_first;
+        if (allow != SIZE_MAX) {
+            cnt = sock_iov_clamp(iov, cnt, allow, clamped);
+            iov = clamped;
+        }
+
+        ssize_t n = lwip_writev(c->fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return ESP_FAIL;
+        }
+
+        if (allow != SIZE_MAX) {
+            tb_consume(&c->bucket, n);
+            tb_consume(&total_bucket, n);
+        }
+        c->last_progress_us = now;
+        c->iov_first += sock_iov_advance(&c->iov[c->iov_first], c->iov_cnt - c->iov_first, n);
+        if (c->iov_first == c->iov_cnt && c->inflight) {
+            client_finish_frame(c, esp_timer_get_time());
+        }
+    }
+
+    if (client_busy(c) && now - c->last_progress_us > (int64_t)SEND_TIMEOUT_MS * 1000) {
+        ESP_LOGW(TAG, "Client %d stalled", (int)(c - mjpeg_clients));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// --- Legacy port handshake ---
+// Reads the request line of a :81 connection without blocking the engine.
+// GET /stream becomes a regular client slot; anything else is answered and closed.
+static void legacy_accept(void)
+{
+    int fd = accept(legacy_listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        legacy_conn_t *lc = &legacy_conns[i];
+        if (lc->fd < 0) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            lc->fd = fd;
+            lc->len = 0;
+            lc->deadline_us = esp_timer_get_time() + (int64_t)LEGACY_REQ_TIMEOUT_MS * 1000;
+            return;
+        }
+    }
+
+    // Every handshake slot busy: the viewer slots are too
+    send(fd, _LEGACY_BUSY, strlen(_LEGACY_BUSY), 0);
+    close(fd);
+}
+
+static void legacy_reply_close(legacy_conn_t *lc, const char *resp)
+{
+    send(lc->fd, resp, strlen(resp), 0);
+    close(lc->fd);
+    lc->fd = -1;
+}
+
+static void legacy_read(legacy_conn_t *lc, int64_t now)
+{
+    ssize_t n = recv(lc->fd, lc->buf + lc->len, sizeof(lc->buf) - 1 - lc->len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        close(lc->fd);
+        lc->fd = -1;
+        return;
+    }
+    if (n > 0) {
+        lc->len += n;
+        lc->buf[lc->len] = '\0';
+    }
+
+    if (!strstr(lc->buf, "\r\n\r\n")) {
+        if (lc->len == sizeof(lc->buf) - 1 || now > lc->deadline_us) {
+            legacy_reply_close(lc, _LEGACY_NOT_FOUND);
+        }
+        return;
+    }
+
+    const char *path = "GET /stream";
+    size_t plen = strlen(path);
+    if (strncmp(lc->buf, path, plen) != 0 ||
+        (lc->buf[plen] != ' ' && lc->buf[plen] != '?')) {
+        legacy_reply_close(lc, _LEGACY_NOT_FOUND);
+        return;
+    }
+
+    // Request line: GET /stream?fps=N HTTP/1.1
+    stream_opts_t opts;
+    if (lc->buf[plen] == '?') {
+        char *end = strpbrk(lc->buf + plen, " \r");
+        if (end) *end = '\0';
+        stream_parse_opts(lc->buf + plen + 1, &opts);
+    } else {
+        stream_parse_opts(NULL, &opts);
+    }
+
+    mjpeg_client_t *slot = client_reserve(&opts);
+    if (!slot) {
+        legacy_reply_close(lc, _LEGACY_BUSY);
+        return;
+    }
+
+    int fd = lc->fd;
+    lc->fd = -1;
+    client_activate(slot, fd, NULL, STREAM_MJPEG, &opts);
+}
+
+// --- Stream engine ---
+// One task owns every viewer socket. It select()s on the sockets that have a
+// frame in flight, WebSocket sockets for upstream messages and the wake
+// eventfd, and writes with non-blocking writev().
+// A viewer costs a socket and a slot instead of a task stack. A slow viewer
+// only holds up its own frames. Each slot keeps only the newest pending frame,
+// so when a link clears the newest frame is what goes out.
+static void stream_engine_task(void *arg)
+{
+    tb_init(&total_bucket, shaper.total_Bps, SHAPER_BURST_BYTES, esp_timer_get_time());
+
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        int64_t next_due = INT64_MAX;
+        fd_set wfds, rfds;
+        FD_ZERO(&wfds);
+        FD_ZERO(&rfds);
+        FD_SET(wake_fd, &rfds);
+        int maxfd = wake_fd;
+        bool any_inflight = false;
+
+        if (total_bucket.rate_Bps != shaper.total_Bps) {
+            tb_set_rate(&total_bucket, shaper.total_Bps, now);
+        }
+
+        if (legacy_listen_fd >= 0) {
+            FD_SET(legacy_listen_fd, &rfds);
+            if (legacy_listen_fd > maxfd) maxfd = legacy_listen_fd;
+        }
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            legacy_conn_t *lc = &legacy_conns[i];
+            if (lc->fd < 0) continue;
+            FD_SET(lc->fd, &rfds);
+            if (lc->fd > maxfd) maxfd = lc->fd;
+            if (lc->deadline_us < next_due) next_due = lc->deadline_us;
+        }
+
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            mjpeg_client_t *c = &mjpeg_clients[i];
+            if (!c->connected || c->fd < 0) continue;
+
+            if (!client_busy(c) && c->pending) {
+                if (!client_window_open(c)) {
+                    c->congested = true;    // waiting for acks, woken by the read below
+                } else if (now >= c->next_due_us) {
+                    client_start_frame(c, now);
+                } else if (c->next_due_us < next_due) {
+                    next_due = c->next_due_us;
+                }
+            }
+
+            if (client_busy(c) && client_pump(c, now) != ESP_OK) {
+                drop_count(DROP_SEND_FAIL, 1);
+                ESP_LOGW(TAG, "Client %d disconnected", i);
+                client_detach(c);
+                continue;
+            }
+
+            if (c->kind == STREAM_WS) {
+                FD_SET(c->fd, &rfds);
+                if (c->fd > maxfd) maxfd = c->fd;
+            }
+            if (c->inflight && c->shape_due_us) {
+                // Held back by the shaper: the timer resumes it, not writability
+                if (c->shape_due_us < next_due) next_due = c->shape_due_us;
+            } else if (client_busy(c)) {
+                FD_SET(c->fd, &wfds);
+                if (c->fd > maxfd) maxfd = c->fd;
+                any_inflight = true;
+            } else if (c->pending && client_window_open(c) && c->next_due_us < next_due) {
+                // Frame finished in this pass and a newer one is already waiting
+                next_due = c->next_due_us;
+            }
+        }
+
+        // Sleep until a socket is writable, a frame is published or a paced or
+        // shaped client becomes due; with frames in flight also wake for the stall check
+        const int64_t stall_check_us = (int64_t)SEND_TIMEOUT_MS * 1000;
+        int64_t wait_us = next_due == INT64_MAX ? INT64_MAX : next_due - now;
+        if (wait_us < 0) wait_us = 0;
+        if (any_inflight && wait_us > stall_check_us) wait_us = stall_check_us;
+
+        struct timeval tv;
+        struct timeval *tvp = NULL;
+        if (wait_us != INT64_MAX) {
+            tv.tv_sec  = wait_us / 1000000;
+            tv.tv_usec = wait_us % 1000000;
+            tvp = &tv;
+        }
+
+        if (select(maxfd + 1, &rfds, &wfds, NULL, tvp) <= 0) {
+            FD_ZERO(&rfds);
+        }
+        if (FD_ISSET(wake_fd, &rfds)) {
+            uint64_t cnt;
+            read(wake_fd, &cnt, sizeof(cnt));
+        }
+
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            mjpeg_client_t *c = &mjpeg_clients[i];
+            if (c->connected && c->fd >= 0 && c->kind == STREAM_WS &&
+                FD_ISSET(c->fd, &rfds) && ws_client_read(c) != ESP_OK) {
+                ESP_LOGI(TAG, "Client %d closed", i);
+                client_detach(c);
+            }
+        }
+
+        now = esp_timer_get_time();
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            legacy_conn_t *lc = &legacy_conns[i];
+            if (lc->fd >= 0 && (FD_ISSET(lc->fd, &rfds) || now > lc->deadline_us)) {
+                legacy_read(lc, now);
+            }
+        }
+        if (legacy_listen_fd >= 0 && FD_ISSET(legacy_listen_fd, &rfds)) {
+            legacy_accept();
+        }
+    }
+}
+
+void stream_init(void)
+{
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        mjpeg_clients[i].fd = -1;
+        legacy_conns[i].fd = -1;
+    }
+
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_vfs_eventfd_register(&config));
+
+    wake_fd = eventfd(0, 0);
+    if (wake_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create engine eventfd");
+        return;
+    }
+
+    xTaskCreate(stream_engine_task, "stream_engine", ENGINE_STACK_SIZE,
+                NULL, ENGINE_PRIORITY, NULL);
+}
+
+esp_err_t stream_listen_legacy(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 2) < 0) {
+        ESP_LOGE(TAG, "Legacy stream port %u unavailable", port);
+        close(fd);
+        return ESP_FAIL;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    legacy_listen_fd = fd;
+    engine_wake();  // pick the listener up in the next select()
+    ESP_LOGI(TAG, "Legacy stream port %u -> /stream", port);
+    return ESP_OK;
+}
+
+static int query_int(const char *query, const char *key, int def, int min, int max)
+{
+    char param[8];
+    if (!query || httpd_query_key_value(query, key, param, sizeof(param)) != ESP_OK) {
+        return def;
+    }
+    int v = atoi(param);
+    if (v < min) v = min;
+    if (v > max) v = max;
+    return v;
+}
+
+void stream_parse_opts(const char *query, stream_opts_t *opts)
+{
+    opts->fps = query_int(query, "fps", STREAM_DEFAULT_FPS, 1, STREAM_MAX_FPS);
+    opts->scale = query_int(query, "scale", 1, 1, 4);
+    if (opts->scale != 2 && opts->scale != 4) opts->scale = 1;
+    opts->quality = query_int(query, "q", TRANSCODE_DEFAULT_QUALITY, 1, 100);
+}
+
+esp_err_t stream_client_attach(httpd_req_t *req, stream_kind_t kind, const stream_opts_t *opts)
+{
+    mjpeg_client_t *slot = client_reserve(opts);
+    if (!slot) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Keeps httpd off the socket while the engine owns it
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        client_unreserve(slot);
+        return ESP_FAIL;
+    }
+
+    client_activate(slot, httpd_req_to_sockfd(async_req), async_req, kind, opts);
+    return ESP_OK;
+}
+
+void stream_publish(frame_ref_t *ref, int profile)
+{
+    bool queued = false;
+    int64_t now = esp_timer_get_time();
+
+    if (profile == 0) {
+        portENTER_CRITICAL(&clients_lock);
+        frame_ref_t *prev = latest_frame;
+        latest_frame = frame_ref_get(ref);
+        portEXIT_CRITICAL(&clients_lock);
+        frame_ref_put(prev);
+    }
+
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        mjpeg_client_t *c = &mjpeg_clients[i];
+        frame_ref_t *old = NULL;
+        bool link_behind = false;
+
+        // The slot gets its own reference; an unsent older frame is skipped
+        portENTER_CRITICAL(&clients_lock);
+        if (c->connected && c->fd >= 0 && c->profile == profile) {
+            old = c->pending;
+            c->pending = frame_ref_get(ref);
+            link_behind = now >= c->rate_due_us;
+            queued = true;
+        }
+        portEXIT_CRITICAL(&clients_lock);
+
+        if (old) {
+            drop_count(link_behind ? DROP_CLIENT_CONGESTED : DROP_CLIENT_RATE, 1);
+            if (link_behind && profile == 0) {
+                quality_ctl_skipped();
+            }
+            frame_ref_put(old);
+        }
+    }
+
+    if (queued) {
+        engine_wake();
+    }
+}
+
+void stream_shaper_get(stream_shaper_t *cfg)
+{
+    cfg->enabled = shaper.enabled;
+    cfg->client_Bps = shaper.client_Bps;
+    cfg->total_Bps = shaper.total_Bps;
+}
+
+void stream_shaper_set(const stream_shaper_t *cfg)
+{
+    shaper.client_Bps = cfg->client_Bps;
+    shaper.total_Bps = cfg->total_Bps;
+    shaper.enabled = cfg->enabled;
+    engine_wake();
+
+    ESP_LOGI(TAG, "Shaper %s, %lu B/s per client, %lu B/s total",
+             cfg->enabled ? "on" : "off",
+             (unsigned long)cfg->client_Bps, (unsigned long)cfg->total_Bps);
+}
+
+frame_ref_t *stream_latest(void)
+{
+    portENTER_CRITICAL(&clients_lock);
+    frame_ref_t *ref = latest_frame ? frame_ref_get(latest_frame) : NULL;
+    portEXIT_CRITICAL(&clients_lock);
+    return ref;
+}
+
+int stream_clients_json(char *buf, size_t len)
+{
+    int off = snprintf(buf, len, "[");
+    bool first = true;
+
+    for (int i = 0; i < MAX_STREAM_CLIENTS && off < (int)len; i++) {
+        const mjpeg_client_t *c = &mjpeg_clients[i];
+        if (!c->connected || c->fd < 0) continue;
+        off += snprintf(buf + off, len - off,
+                        "%s{\"id\":%d,\"proto\":\"%s\",\"fps\":%lu,\"scale\":%d,"
+                        "\"rate_kbps\":%lu,\"send_ms\":%lu,\"congested\":%s}",
+                        first ? "" : ",", i, c->kind == STREAM_WS ? "ws" : "mjpeg",
+                        (unsigned long)(1000000 / c->min_interval_us), c->scale,
+                        (unsigned long)(c->rate_Bps * 8 / 1000),
+                        (unsigned long)(c->send_us / 1000),
+                        c->congested ? "true" : "false");
+        first = false;
+    }
+    if (off < (int)len) off += snprintf(buf + off, len - off, "]");
+    return off;
+}
+
+// --- Stream Task ---
+// Takes the newest frame from frame_ring and fans it out to clients.
+// Sleeps on a task notification from camera_capture_task instead of polling.
+// Frame rate is capped per client by its sender, not here.
+void stream_task(void *pvParameters)
+{
+    stream_task_handle = xTaskGetCurrentTaskHandle();
+
+    while (1) {
+
+        // --- Wait for the next published frame ---
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Only the newest frame is worth sending; older ones are released
+        uint32_t skipped = 0;
+        frame_ref_t *ref = frame_ring_pop_latest(&frame_ring, &skipped);
+        drop_count(DROP_RING_STALE, skipped);
+        if (!ref) {
+            continue;
+        }
+        latency_record(LAT_RING_WAIT, esp_timer_get_time() - ref->publish_us);
+
+        // --- JPEG sanity check ---
+        const camera_fb_t *fb = ref->fb;
+        if (fb->len > 4 &&
+            fb->buf[0] == 0xFF && fb->buf[1] == 0xD8 &&
+            fb->buf[fb->len - 2] == 0xFF &&
+            fb->buf[fb->len - 1] == 0xD9) {
+            quality_ctl_frame(fb->len);
+            stream_publish(ref, 0);
+            frame_poll_notify();
+            transcode_submit(ref);
+            face_submit(ref);
+            rtsp_publish(ref);
+            mcast_publish(ref);
+        } else {
+            drop_count(DROP_BAD_JPEG, 1);
+        }
+        frame_ref_put(ref);
+    }
+}
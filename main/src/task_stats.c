@@ -0,0 +1,79 @@
+#include "task_stats.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+#define MAX_TRACKED_TASKS   24
+
+// Run-time counters seen on the previous call, so each report covers one interval
+static struct {
+    TaskHandle_t handle;
+    uint32_t     runtime;
+} prev[MAX_TRACKED_TASKS];
+static int prev_count = 0;
+static uint32_t prev_total = 0;
+
+static uint32_t prev_runtime(TaskHandle_t handle)
+{
+    for (int i = 0; i < prev_count; i++) {
+        if (prev[i].handle == handle) return prev[i].runtime;
+    }
+    return 0;
+}
+
+int task_stats_json(char *buf, size_t len)
+{
+    TaskStatus_t status[MAX_TRACKED_TASKS];
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, MAX_TRACKED_TASKS, &total);
+    if (n == 0) {
+        return snprintf(buf, len, "{\"error\":\"too many tasks\"}");
+    }
+
+    // `total` is the run-time clock itself (esp_timer microseconds), the same
+    // on both cores, not a sum over them. A task runs on one core at a time,
+    // so 100% = one core fully busy and all tasks add up to 200% on the ESP32.
+    uint32_t interval = total - prev_total;
+    if (interval == 0) interval = 1;
+
+    int off = snprintf(buf, len, "{\"interval_us\":%lu,\"tasks\":[",
+                       (unsigned long)interval);
+
+    for (UBaseType_t i = 0; i < n && off < (int)len; i++) {
+        uint32_t used = status[i].ulRunTimeCounter - prev_runtime(status[i].xHandle);
+        off += snprintf(buf + off, len - off,
+                        "%s{\"name\":\"%s\",\"core\":%d,\"cpu_pct\":%lu.%lu,\"stack_free\":%lu}",
+                        i ? "," : "",
+                        status[i].pcTaskName,
+                        status[i].xCoreID == tskNO_AFFINITY ? -1 : (int)status[i].xCoreID,
+                        (unsigned long)((uint64_t)used * 100 / interval),
+                        (unsigned long)((uint64_t)used * 1000 / interval % 10),
+                        (unsigned long)status[i].usStackHighWaterMark);
+    }
+    if (off < (int)len) {
+        off += snprintf(buf + off, len - off, "]}");
+    }
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        prev[i].handle  = status[i].xHandle;
+        prev[i].runtime = status[i].ulRunTimeCounter;
+    }
+    prev_count = n;
+    prev_total = total;
+
+    return off;
+}
+
+#else
+
+int task_stats_json(char *buf, size_t len)
+{
+    return snprintf(buf, len,
+        "{\"error\":\"enable CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\"}");
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "token_bucket.h"
+
+static void tb_refill(token_bucket_t *tb, int64_t now_us)
+{
+    int64_t cap = (int64_t)tb->burst * 1000000;
+    if (now_us > tb->last_us) {
+        tb->credit += (int64_t)tb->rate_Bps * (now_us - tb->last_us);
+        if (tb->credit > cap) tb->credit = cap;
+    }
+    tb->last_us = now_us;
+}
+
+void tb_init(token_bucket_t *tb, uint32_t rate_Bps, uint32_t burst, int64_t now_us)
+{
+    tb->rate_Bps = rate_Bps;
+    tb->burst = burst;
+    tb->credit = (int64_t)burst * 1000000;
+    tb->last_us = now_us;
+}
+
+void tb_set_rate(token_bucket_t *tb, uint32_t rate_Bps, int64_t now_us)
+{
+    tb_refill(tb, now_us);
+    tb->rate_Bps = rate_Bps;
+}
+
+size_t tb_available(token_bucket_t *tb, int64_t now_us)
+{
+    if (!tb->rate_Bps) return SIZE_MAX;
+    tb_refill(tb, now_us);
+    return (size_t)(tb->credit / 1000000);
+}
+
+void tb_consume(token_bucket_t *tb, size_t bytes)
+{
+    if (tb->rate_Bps) tb->credit -= (int64_t)bytes * 1000000;
+}
+
+int64_t tb_wait_us(const token_bucket_t *tb, size_t bytes)
+{
+    if (!tb->rate_Bps) return 0;
+    int64_t missing = (int64_t)bytes * 1000000 - tb->credit;
+    if (missing <= 0) return 0;
+    return (missing + tb->rate_Bps - 1) / tb->rate_Bps;
+}
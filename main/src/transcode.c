@@ -0,0 +1,179 @@
+#include "transcode.h"
+#include "stream.h"
+#include "common.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "jpeg_decoder.h"
+#include "img_converters.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "TRANSCODE";
+
+#define TRANSCODE_STACK_SIZE    8192    // fmt2jpg keeps its encoder state on the stack
+#define TRANSCODE_PRIORITY      3       // below capture and the stream engine
+
+typedef struct {
+    uint8_t scale;      // 0 = unused
+    uint8_t quality;
+    uint8_t clients;
+} transcode_profile_t;
+
+// Index 0 stands for the original frames and is never used here
+static transcode_profile_t profiles[TRANSCODE_MAX_PROFILES + 1];
+static portMUX_TYPE profiles_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t transcode_task_handle = NULL;
+static frame_ref_t *pending = NULL;     // guarded by profiles_lock
+
+// RGB565 of the current scale, reused while frames keep the same size
+static uint8_t *rgb_buf = NULL;
+static size_t rgb_cap = 0;
+
+int transcode_profile_acquire(uint8_t scale, uint8_t quality)
+{
+    int id = -1;
+
+    portENTER_CRITICAL(&profiles_lock);
+    for (int i = 1; i <= TRANSCODE_MAX_PROFILES; i++) {
+        transcode_profile_t *p = &profiles[i];
+        if (p->clients && p->scale == scale && p->quality == quality) {
+            id = i;
+            break;
+        }
+        if (!p->clients && id < 0) {
+            id = i;     // first free entry, used if no match turns up
+        }
+    }
+    if (id > 0) {
+        profiles[id].scale = scale;
+        profiles[id].quality = quality;
+        profiles[id].clients++;
+    }
+    portEXIT_CRITICAL(&profiles_lock);
+    return id;
+}
+
+void transcode_profile_release(int id)
+{
+    if (id <= 0 || id > TRANSCODE_MAX_PROFILES) return;
+
+    portENTER_CRITICAL(&profiles_lock);
+    if (profiles[id].clients) profiles[id].clients--;
+    portEXIT_CRITICAL(&profiles_lock);
+}
+
+void transcode_submit(frame_ref_t *ref)
+{
+    bool active = false;
+    frame_ref_t *old = NULL;
+
+    portENTER_CRITICAL(&profiles_lock);
+    for (int i = 1; i <= TRANSCODE_MAX_PROFILES; i++) {
+        if (profiles[i].clients) active = true;
+    }
+    if (active) {
+        old = pending;
+        pending = frame_ref_get(ref);
+    }
+    portEXIT_CRITICAL(&profiles_lock);
+
+    if (old) {
+        drop_count(DROP_TRANSCODE_BUSY, 1);
+        frame_ref_put(old);
+    }
+    if (active) {
+        xTaskNotifyGive(transcode_task_handle);
+    }
+}
+
+// Decode `src` at 1/scale into rgb_buf (big-endian RGB565, as fmt2jpg expects)
+static esp_err_t decode_scaled(const frame_ref_t *src, uint8_t scale,
+                               uint16_t *width, uint16_t *height)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = src->fb->buf,
+        .indata_size = src->fb->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = scale == 4 ? JPEG_IMAGE_SCALE_1_4 : JPEG_IMAGE_SCALE_1_2,
+        .flags.swap_color_bytes = 1,
+    };
+    esp_jpeg_image_output_t img;
+
+    if (esp_jpeg_get_image_info(&cfg, &img) != ESP_OK) return ESP_FAIL;
+    if (img.output_len > rgb_cap) {
+        heap_caps_free(rgb_buf);
+        rgb_buf = heap_caps_malloc(img.output_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        rgb_cap = rgb_buf ? img.output_len : 0;
+        if (!rgb_buf) return ESP_ERR_NO_MEM;
+    }
+
+    cfg.outbuf = rgb_buf;
+    cfg.outbuf_size = rgb_cap;
+    cfg.priv.read = 0;
+    if (esp_jpeg_decode(&cfg, &img) != ESP_OK) return ESP_FAIL;
+
+    *width = img.width;
+    *height = img.height;
+    return ESP_OK;
+}
+
+// --- Transcode Task ---
+// Takes the newest sensor frame and produces one frame per active profile.
+// Profiles sharing a scale share the decode; each quality is encoded once and
+// published to all of its clients.
+static void transcode_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        transcode_profile_t active[TRANSCODE_MAX_PROFILES + 1];
+        portENTER_CRITICAL(&profiles_lock);
+        frame_ref_t *src = pending;
+        pending = NULL;
+        memcpy(active, profiles, sizeof(active));
+        portEXIT_CRITICAL(&profiles_lock);
+
+        if (!src) continue;
+
+        static const uint8_t scales[] = { 2, 4 };
+        for (int s = 0; s < (int)sizeof(scales); s++) {
+            bool decoded = false;
+            uint16_t w = 0, h = 0;
+
+            for (int id = 1; id <= TRANSCODE_MAX_PROFILES; id++) {
+                const transcode_profile_t *p = &active[id];
+                if (!p->clients || p->scale != scales[s]) continue;
+
+                if (!decoded) {
+                    if (decode_scaled(src, p->scale, &w, &h) != ESP_OK) {
+                        ESP_LOGW(TAG, "Decode of frame %lu failed", (unsigned long)src->seq);
+                        break;
+                    }
+                    decoded = true;
+                }
+
+                uint8_t *jpg = NULL;
+                size_t jpg_len = 0;
+                if (!fmt2jpg(rgb_buf, (size_t)w * h * 2, w, h, PIXFORMAT_RGB565,
+                             p->quality, &jpg, &jpg_len)) {
+                    ESP_LOGW(TAG, "Encode failed (profile %d)", id);
+                    continue;
+                }
+
+                frame_ref_t *out = frame_ref_from_jpeg(jpg, jpg_len, w, h, src);
+                if (out) {
+                    stream_publish(out, id);
+                    frame_ref_put(out);
+                }
+            }
+        }
+        frame_ref_put(src);
+    }
+}
+
+void transcode_init(void)
+{
+    xTaskCreate(transcode_task, "transcode", TRANSCODE_STACK_SIZE, NULL,
+                TRANSCODE_PRIORITY, &transcode_task_handle);
+}
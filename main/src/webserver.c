@@ -2,126 +2,231 @@
 #include "common.h"
 #include "servo.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include <stdlib.h>
 #include <string.h>
 #include "webserver.h"
+#include "stream.h"
+#include "task_stats.h"
+#include "latency_hist.h"
+#include "frame_poll.h"
+#include "quality_ctl.h"
+#include "face_task.h"
+#include "model_store.h"
 
 
 static const char *TAG = "WEB_SERVER";
 
-// --- Stream Task ---
-void stream_task(void *pvParameters)
+// Every lwIP socket the firmware can hold at once: httpd sessions and its own
+// sockets; the :81 listener, its handshakes and its viewers (httpd sessions may
+// all be taken by other requests meanwhile); the RTSP listener with a TCP and
+// an RTP socket per session; the multicast sender.
+#define SOCKETS_WORST_CASE  (HTTPD_SESSIONS + HTTPD_OWN_SOCKETS + \
+                             1 + 2 * MAX_STREAM_CLIENTS +         \
+                             1 + 2 * RTSP_MAX_SESSIONS +          \
+                             MCAST_ENABLED)
+_Static_assert(SOCKETS_WORST_CASE <= CONFIG_LWIP_MAX_SOCKETS,
+               "raise CONFIG_LWIP_MAX_SOCKETS in sdkconfig.defaults");
+
+// Streams and parked polls hold their session, so only take one while that
+// still leaves CONTROL_SOCKETS sessions for everything else
+static bool long_lived_allowed(httpd_req_t *req)
 {
-    char part_buf[512];
-    static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
-    static const char* _STREAM_PART =
-        "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
-
-    uint32_t frame_number = 0;
-    static uint32_t last_send = 0;   // tick of last sent frame
+    int fds[HTTPD_SESSIONS];
+    size_t open = HTTPD_SESSIONS;
+    if (httpd_get_client_list(req->handle, &open, fds) != ESP_OK) {
+        return false;
+    }
+    return open + CONTROL_SOCKETS <= HTTPD_SESSIONS;
+}
 
-    while (1) {
+// A refused stream or poll must not stay open as an idle keep-alive session
+static esp_err_t reject_busy(httpd_req_t *req, const char *msg)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Connection", "close");
+    httpd_resp_sendstr(req, msg);
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    return ESP_OK;
+}
 
-        // --- Wait for Wi-Fi ---
-        if (!(xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT)) {
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+// /stream and /ws/stream take ?fps=N&scale=2|4&q=N
+static void request_opts(httpd_req_t *req, stream_opts_t *opts)
+{
+    char query[48];
+    bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+    stream_parse_opts(has_query ? query : NULL, opts);
+}
 
-        // --- Wait for MJPEG client ---
-        if (!mjpeg_client.connected || !mjpeg_client.req) {
-            vTaskDelay(pdMS_TO_TICKS(200));
-            continue;
-        }
+// --- MJPEG Handler ---
+static esp_err_t stream_handler(httpd_req_t *req)
+{
+    // Control requests share this httpd task, so never park it waiting for Wi-Fi
+    if (!(xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Camera not ready");
+        return ESP_OK;
+    }
 
-        int idx = frame_buffer.read_index;
-
-        // --- Frame ready ---
-        if (frame_buffer.ready[idx] && frame_buffer.fb[idx]) {
-
-            camera_fb_t *fb = frame_buffer.fb[idx];
-
-            // --- FPS limit (~20 FPS) ---
-            uint32_t now = xTaskGetTickCount();
-            if (now - last_send < pdMS_TO_TICKS(50)) {
-                // Too early to send next frame
-                vTaskDelay(pdMS_TO_TICKS(1));
-                continue;
-            }
-            last_send = now;
-
-            // --- JPEG sanity check ---
-            if (fb->len > 4 &&
-                fb->buf[0] == 0xFF && fb->buf[1] == 0xD8 &&
-                fb->buf[fb->len - 2] == 0xFF &&
-                fb->buf[fb->len - 1] == 0xD9) {
-
-                int hlen = snprintf(part_buf, sizeof(part_buf),
-                                    _STREAM_PART, fb->len);
-
-                // --- Send frame ---
-                if (httpd_resp_send_chunk(mjpeg_client.req,
-                                          _STREAM_BOUNDARY,
-                                          strlen(_STREAM_BOUNDARY)) != ESP_OK ||
-                    httpd_resp_send_chunk(mjpeg_client.req,
-                                          part_buf, hlen) != ESP_OK ||
-                    httpd_resp_send_chunk(mjpeg_client.req,
-                                          (const char *)fb->buf,
-                                          fb->len) != ESP_OK) {
-
-                    ESP_LOGW("STREAM", "Client disconnected, resetting");
-                    mjpeg_client.connected = 0;
-                    mjpeg_client.req = NULL;
-                } else {
-                    total_frames_sent++;
-                    frame_number++;
-                }
-            }
-
-            // --- Return frame buffer to camera ---
-            esp_camera_fb_return(fb);
-            frame_buffer.fb[idx] = NULL;
-            frame_buffer.ready[idx] = false;
-
-            // --- Switch buffer index ---
-            frame_buffer.read_index ^= 1;
-        }
+    if (!long_lived_allowed(req)) {
+        ESP_LOGW("MJPEG", "Client rejected, sessions left are reserved for control");
+        return reject_busy(req, "Too many connections");
+    }
 
-        // Yield CPU (very small delay)
-        vTaskDelay(pdMS_TO_TICKS(1));
+    stream_opts_t opts;
+    request_opts(req, &opts);
+    esp_err_t err = stream_client_attach(req, STREAM_MJPEG, &opts);
+    if (err == ESP_ERR_NO_MEM) {
+        ESP_LOGW("MJPEG", "Client rejected, no free stream slot or transcode profile");
+        return reject_busy(req, "Too many viewers");
     }
+
+    // On success the stream engine owns the socket from here on
+    return err;
 }
 
+// --- WebSocket Stream Handler ---
+// httpd has answered the handshake when this runs; the socket then belongs to
+// the stream engine, which also reads the viewer's upstream messages.
+static esp_err_t ws_stream_handler(httpd_req_t *req)
+{
+    if (req->method != HTTP_GET) {
+        return ESP_OK;      // not reached: httpd stops reading once the engine owns the socket
+    }
 
-// --- MJPEG Handler ---
-static esp_err_t stream_handler(httpd_req_t *req)
-{    
-    while (!(xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT)) {
-        vTaskDelay(pdMS_TO_TICKS(500));
+    stream_opts_t opts;
+    request_opts(req, &opts);
+    esp_err_t err = long_lived_allowed(req) ? stream_client_attach(req, STREAM_WS, &opts)
+                                            : ESP_ERR_NO_MEM;
+    if (err == ESP_ERR_NO_MEM) {
+        ESP_LOGW("MJPEG", "WS client rejected, no free stream slot, transcode profile or session");
+        uint8_t code[2] = { 1013 >> 8, 1013 & 0xFF };     // try again later
+        httpd_ws_frame_t close = {
+            .final = true,
+            .type = HTTPD_WS_TYPE_CLOSE,
+            .payload = code,
+            .len = sizeof(code),
+        };
+        httpd_ws_send_frame(req, &close);
+        return ESP_FAIL;    // httpd closes the session
     }
+    return err;
+}
 
-    if (mjpeg_client.connected) {
-        ESP_LOGW("MJPEG", "Second client rejected");
-        httpd_resp_send_err(req, 409, "Stream already in use");
-        return ESP_FAIL;
+// --- Capture Handler ---
+// GET /capture returns the newest published JPEG. The ETag is the frame
+// sequence number, so a poller sending If-None-Match gets 304 until a new
+// frame arrives. The stream path is not touched.
+static esp_err_t capture_handler(httpd_req_t *req)
+{
+    frame_ref_t *ref = stream_latest();
+    if (!ref) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "No frame yet");
+        return ESP_OK;
     }
 
-    ESP_LOGI("MJPEG", "Client connected");
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)ref->seq);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    // Same metadata as a /stream part
+    char seq[12];
+    char capture_us[24];
+    snprintf(seq, sizeof(seq), "%lu", (unsigned long)ref->seq);
+    snprintf(capture_us, sizeof(capture_us), "%lld", (long long)ref->capture_us);
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    httpd_resp_set_hdr(req, "X-Capture-Us", capture_us);
+
+    char inm[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strstr(inm, etag)) {
+        frame_ref_put(ref);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
 
-    mjpeg_client.connected = 1;
-    mjpeg_client.req = req;
-    httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=frame");
+    httpd_resp_set_type(req, "image/jpeg");
+    esp_err_t err = httpd_resp_send(req, (const char *)ref->fb->buf, ref->fb->len);
+    frame_ref_put(ref);
+    return err;
+}
 
-    while (mjpeg_client.connected) {
-        if (httpd_req_to_sockfd(req) < 0) {
-            mjpeg_client.connected = 0;
-            mjpeg_client.req = NULL;
-            break;
+// --- Frame Long-Poll Handler ---
+// GET /frame?after=SEQ&timeout=MS, see frame_poll.h. Answered here when a
+// newer frame is already there, otherwise parked for the poll task.
+static esp_err_t frame_handler(httpd_req_t *req)
+{
+    uint32_t after = 0;
+    uint32_t timeout_ms = FRAME_POLL_DEFAULT_MS;
+    bool has_after = false;
+
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char param[12];
+        if (httpd_query_key_value(query, "after", param, sizeof(param)) == ESP_OK) {
+            after = strtoul(param, NULL, 10);
+            has_after = true;
+        }
+        if (httpd_query_key_value(query, "timeout", param, sizeof(param)) == ESP_OK) {
+            timeout_ms = strtoul(param, NULL, 10);
+            if (timeout_ms > FRAME_POLL_MAX_MS) timeout_ms = FRAME_POLL_MAX_MS;
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
     }
 
-    ESP_LOGI("MJPEG", "Client disconnected");
+    frame_ref_t *ref = stream_latest();
+    if (ref && (!has_after || frame_seq_after(ref->seq, after))) {
+        esp_err_t err = frame_poll_send_frame(req, ref);
+        frame_ref_put(ref);
+        return err;
+    }
+    if (timeout_ms == 0) {
+        esp_err_t err = frame_poll_send_timeout(req, ref);
+        frame_ref_put(ref);
+        return err;
+    }
+    frame_ref_put(ref);
+
+    if (!long_lived_allowed(req)) {
+        return reject_busy(req, "Too many connections");
+    }
+    esp_err_t err = frame_poll_wait(req, after, timeout_ms);
+    if (err == ESP_ERR_NO_MEM) {
+        return reject_busy(req, "Too many pollers");
+    }
+    return err;
+}
+
+// --- Faces Handler ---
+// GET /faces returns the latest detections with the seq of their frame
+static esp_err_t faces_handler(httpd_req_t *req)
+{
+    char json[1024];
+    face_json(json, sizeof(json));
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_sendstr(req, json);
+    return ESP_OK;
+}
+
+// --- Model Handler ---
+// GET /model describes the flashed model and its memory plan
+static esp_err_t model_handler(httpd_req_t *req)
+{
+    const size_t len = 6144;    // plan lists every tensor
+    char *json = malloc(len);
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+        return ESP_FAIL;
+    }
+
+    model_json(json, len);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json);
+    free(json);
     return ESP_OK;
 }
 
@@ -157,56 +262,159 @@ static esp_err_t servo_handler(httpd_req_t *req)
 // --- Status Handler ---
 static esp_err_t status_handler(httpd_req_t *req)
 {
-    char json[512];
+    char json[1536];
+    int off = snprintf(json, sizeof(json),
+        "{\"frames_captured\":%lu,\"frames_sent\":%lu,\"frames_dropped\":%lu,"
+        "\"frames_decimated\":%lu,\"drops\":",
+        total_frames_captured, total_frames_sent, drop_total(),
+        (unsigned long)drop_get(DROP_CLIENT_RATE));
+    // Each helper returns its untruncated length, so stop once the buffer is full
+    if (off < (int)sizeof(json)) off += drop_stats_json(json + off, sizeof(json) - off);
+    if (off < (int)sizeof(json)) off += snprintf(json + off, sizeof(json) - off, ",\"clients\":");
+    if (off < (int)sizeof(json)) off += stream_clients_json(json + off, sizeof(json) - off);
+    if (off < (int)sizeof(json)) off += snprintf(json + off, sizeof(json) - off, ",\"camera\":");
+    if (off < (int)sizeof(json)) off += quality_ctl_json(json + off, sizeof(json) - off);
+    if (off < (int)sizeof(json)) snprintf(json + off, sizeof(json) - off, "}");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json);
+    return ESP_OK;
+}
+
+// --- Task CPU Handler ---
+// Per-task CPU share since the previous request to /tasks
+static esp_err_t tasks_handler(httpd_req_t *req)
+{
+    const size_t len = 2048;
+    char *json = malloc(len);
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+        return ESP_FAIL;
+    }
+
+    task_stats_json(json, len);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json);
+    free(json);
+    return ESP_OK;
+}
+
+// --- Latency Handler ---
+// GET /latency returns per-stage histograms, /latency?reset=1 also clears them
+static esp_err_t latency_handler(httpd_req_t *req)
+{
+    const size_t len = 4096;
+    char *json = malloc(len);
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+        return ESP_FAIL;
+    }
+
+    latency_json(json, len);
+
+    char query[32];
+    char param[4];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "reset", param, sizeof(param)) == ESP_OK &&
+        atoi(param)) {
+        latency_reset();
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json);
+    free(json);
+    return ESP_OK;
+}
+
+// --- Shaper Handler ---
+// GET /shaper returns the stream shaper settings. POST /shaper with ?on=0|1,
+// ?client_Bps=N and ?total_Bps=N changes them (bytes per second, 0 = no cap)
+// and returns the new settings.
+static esp_err_t shaper_handler(httpd_req_t *req)
+{
+    stream_shaper_t cfg;
+    stream_shaper_get(&cfg);
+
+    char query[96];
+    if (req->method == HTTP_POST &&
+        httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char param[12];
+        if (httpd_query_key_value(query, "on", param, sizeof(param)) == ESP_OK)
+            cfg.enabled = atoi(param) != 0;
+        if (httpd_query_key_value(query, "client_Bps", param, sizeof(param)) == ESP_OK)
+            cfg.client_Bps = strtoul(param, NULL, 10);
+        if (httpd_query_key_value(query, "total_Bps", param, sizeof(param)) == ESP_OK)
+            cfg.total_Bps = strtoul(param, NULL, 10);
+        stream_shaper_set(&cfg);
+    }
+
+    char json[128];
     snprintf(json, sizeof(json),
-        "{\"frames_captured\":%lu,\"frames_sent\":%lu,\"frames_dropped\":%lu}",
-        total_frames_captured, total_frames_sent, total_frames_dropped);
+             "{\"enabled\":%s,\"client_Bps\":%lu,\"total_Bps\":%lu,\"burst\":%d}",
+             cfg.enabled ? "true" : "false", (unsigned long)cfg.client_Bps,
+             (unsigned long)cfg.total_Bps, SHAPER_BURST_BYTES);
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, json);
     return ESP_OK;
 }
 
-// --- Start servers ---
-// port '81' stream, port `80` control
+// --- Start server ---
+// One httpd instance on port 80 serves stream and control. Its socket budget
+// is split: MAX_STREAM_CLIENTS sessions can be held by viewers and
+// FRAME_POLL_MAX_WAITERS by parked /frame requests. Those are refused while
+// fewer than CONTROL_SOCKETS sessions would be left, so /servo and /status
+// still get in. Port 81 keeps answering /stream for old bookmarks through
+// the stream engine.
 void start_webserver(void)
 {
-    // --- Stream Server ---
-    httpd_config_t stream_config = HTTPD_DEFAULT_CONFIG();
-    stream_config.server_port = 81;
-    stream_config.ctrl_port = 8081; 
-    stream_config.max_open_sockets = 4;
-
-    esp_err_t res_stream = httpd_start(&stream_server, &stream_config);
-    if (res_stream == ESP_OK) {
-        ESP_LOGI(TAG, "[STREAM] Server started successfully on port %d", stream_config.server_port);
-        httpd_uri_t stream_uri = {
-            .uri = "/stream",
-            .method = HTTP_GET,
-            .handler = stream_handler
-        };
-        httpd_register_uri_handler(stream_server, &stream_uri);
-    } else {
-        ESP_LOGE(TAG, "[STREAM] Failed to start server on port %d, err=0x%x", stream_config.server_port, res_stream);
-    }
-
-    // Small delay to ensure the first server starts properly
-    vTaskDelay(pdMS_TO_TICKS(100));
-
-    // --- Control Server ---
-    httpd_config_t control_config = HTTPD_DEFAULT_CONFIG();
-    control_config.server_port = 80;
-    control_config.ctrl_port = 8080; 
-    control_config.max_open_sockets = 4;
-
-    esp_err_t res_control = httpd_start(&control_server, &control_config);
-    if (res_control == ESP_OK) {
-        ESP_LOGI(TAG, "[CONTROL] Server started successfully on port %d", control_config.server_port);
-        httpd_uri_t servo_uri  = { .uri="/servo",  .method=HTTP_POST, .handler=servo_handler };
-        httpd_uri_t status_uri = { .uri="/status", .method=HTTP_GET,  .handler=status_handler };
-        httpd_register_uri_handler(control_server, &servo_uri);
-        httpd_register_uri_handler(control_server, &status_uri);
-    } else {
-        ESP_LOGE(TAG, "[CONTROL] Failed to start server on port %d, err=0x%x", control_config.server_port, res_control);
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = 80;
+    config.ctrl_port = 8080;
+    config.max_open_sockets = HTTPD_SESSIONS;
+    config.max_uri_handlers = 16;
+    config.lru_purge_enable = false;    // never evict a viewer to make room
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    esp_err_t res = httpd_start(&web_server, &config);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start server on port %d, err=0x%x", config.server_port, res);
+        return;
     }
+    size_t heap_used = heap_before - heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    // The dropped second instance cost at least its own task stack on top
+    ESP_LOGI(TAG, "Server started on port %d, %d sockets (%d stream + %d poll + %d control), "
+             "%u bytes DRAM, >= %u bytes saved vs. separate stream server",
+             config.server_port, config.max_open_sockets, MAX_STREAM_CLIENTS,
+             FRAME_POLL_MAX_WAITERS, CONTROL_SOCKETS, (unsigned)heap_used, (unsigned)config.stack_size);
+
+    httpd_uri_t stream_uri  = { .uri="/stream",  .method=HTTP_GET,  .handler=stream_handler };
+    httpd_uri_t ws_uri      = { .uri="/ws/stream", .method=HTTP_GET, .handler=ws_stream_handler,
+                                .is_websocket=true, .handle_ws_control_frames=true };
+    httpd_uri_t capture_uri = { .uri="/capture", .method=HTTP_GET,  .handler=capture_handler };
+    httpd_uri_t frame_uri   = { .uri="/frame",   .method=HTTP_GET,  .handler=frame_handler };
+    httpd_uri_t servo_uri   = { .uri="/servo",   .method=HTTP_POST, .handler=servo_handler };
+    httpd_uri_t status_uri  = { .uri="/status",  .method=HTTP_GET,  .handler=status_handler };
+    httpd_uri_t tasks_uri   = { .uri="/tasks",   .method=HTTP_GET,  .handler=tasks_handler };
+    httpd_uri_t latency_uri = { .uri="/latency", .method=HTTP_GET,  .handler=latency_handler };
+    httpd_uri_t shaper_uri  = { .uri="/shaper",  .method=HTTP_GET,  .handler=shaper_handler };
+    httpd_uri_t shaper_set  = { .uri="/shaper",  .method=HTTP_POST, .handler=shaper_handler };
+    httpd_uri_t faces_uri   = { .uri="/faces",   .method=HTTP_GET,  .handler=faces_handler };
+    httpd_uri_t model_uri   = { .uri="/model",   .method=HTTP_GET,  .handler=model_handler };
+    httpd_register_uri_handler(web_server, &stream_uri);
+    httpd_register_uri_handler(web_server, &ws_uri);
+    httpd_register_uri_handler(web_server, &capture_uri);
+    httpd_register_uri_handler(web_server, &frame_uri);
+    httpd_register_uri_handler(web_server, &servo_uri);
+    httpd_register_uri_handler(web_server, &status_uri);
+    httpd_register_uri_handler(web_server, &tasks_uri);
+    httpd_register_uri_handler(web_server, &latency_uri);
+    httpd_register_uri_handler(web_server, &shaper_uri);
+    httpd_register_uri_handler(web_server, &shaper_set);
+    httpd_register_uri_handler(web_server, &faces_uri);
+    httpd_register_uri_handler(web_server, &model_uri);
+
+    stream_listen_legacy(LEGACY_STREAM_PORT);
 }
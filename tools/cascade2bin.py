@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Convert an OpenCV cascade XML into the binary format of main/include/cascade.h.
+
+Takes the cascade format written by opencv_traincascade (and shipped in
+OpenCV's data/haarcascades and data/lbpcascades): BOOST stages of stumps
+with HAAR or LBP features. Leaf values and stage thresholds become Q16,
+Haar node thresholds Q24. Rejected: old-style haartraining files, trees
+deeper than one split, tilted Haar features and non-integral rectangle
+weights.
+
+    python3 tools/cascade2bin.py lbpcascade_frontalface_improved.xml face.cas
+
+Copy the output to the SD card as FACE_CASCADE_PATH (see common.h).
+"""
+
+import argparse
+import struct
+import sys
+import xml.etree.ElementTree as ET
+
+MAGIC = 0x53414346
+VERSION = 1
+HAAR, LBP = 0, 1
+MAX_STAGES = 32
+MAX_RECTS = 3
+LEAF_SHIFT = 16
+THR_SHIFT = 24
+THRESHOLD_EPS = 1e-5        # OpenCV lowers every stage threshold by this on load
+
+
+class ConvertError(Exception):
+    pass
+
+
+def q(value, shift, what):
+    v = int(round(value * (1 << shift)))
+    if not -(1 << 31) <= v < (1 << 31):
+        raise ConvertError("%s %g does not fit Q%d" % (what, value, shift))
+    return v
+
+
+def numbers(node, tag):
+    el = node.find(tag)
+    if el is None or el.text is None:
+        raise ConvertError("missing <%s>" % tag)
+    return el.text.split()
+
+
+def parse(path):
+    root = ET.parse(path).getroot()
+    cascade = root.find("cascade")
+    if cascade is None:
+        raise ConvertError("no <cascade>: old haartraining format is not supported")
+    if cascade.findtext("stageType", "").strip() != "BOOST":
+        raise ConvertError("only BOOST cascades are supported")
+
+    kind = cascade.findtext("featureType", "").strip()
+    if kind not in ("HAAR", "LBP"):
+        raise ConvertError("feature type %r not supported" % kind)
+    ftype = HAAR if kind == "HAAR" else LBP
+    win_w = int(cascade.findtext("width"))
+    win_h = int(cascade.findtext("height"))
+
+    stages = []
+    nodes = []
+    for stage in cascade.find("stages"):
+        weak = stage.find("weakClassifiers")
+        thr = float(stage.findtext("stageThreshold")) - THRESHOLD_EPS
+        stages.append((len(weak), q(thr, LEAF_SHIFT, "stage threshold")))
+        for wc in weak:
+            inner = numbers(wc, "internalNodes")
+            leaves = [float(v) for v in numbers(wc, "leafValues")]
+            expect = 4 if ftype == HAAR else 3 + 8
+            if len(inner) != expect or len(leaves) != 2:
+                raise ConvertError("only stumps (one split per weak classifier) are supported")
+            left = q(leaves[0], LEAF_SHIFT, "leaf")
+            right = q(leaves[1], LEAF_SHIFT, "leaf")
+            feature = int(inner[2])
+            if ftype == HAAR:
+                nodes.append((feature, q(float(inner[3]), THR_SHIFT, "node threshold"),
+                              left, right))
+            else:
+                subset = [int(v) & 0xFFFFFFFF for v in inner[3:]]
+                nodes.append((feature, left, right, subset))
+
+    if not 0 < len(stages) <= MAX_STAGES:
+        raise ConvertError("%d stages, 1..%d supported" % (len(stages), MAX_STAGES))
+
+    features = []
+    for feat in cascade.find("features"):
+        if ftype == LBP:
+            x, y, w, h = (int(v) for v in numbers(feat, "rect"))
+            if x + 3 * w > win_w or y + 3 * h > win_h:
+                raise ConvertError("LBP feature outside the window")
+            features.append((x, y, w, h))
+            continue
+
+        if feat.findtext("tilted", "0").strip() not in ("0", ""):
+            raise ConvertError("tilted Haar features are not supported")
+        rects = []
+        for r in feat.find("rects"):
+            x, y, w, h, weight = r.text.split()
+            weight = float(weight)
+            if weight != int(weight) or not -127 <= weight <= 127:
+                raise ConvertError("rectangle weight %g is not a small integer" % weight)
+            x, y, w, h = int(x), int(y), int(w), int(h)
+            if x + w > win_w or y + h > win_h:
+                raise ConvertError("Haar rectangle outside the window")
+            rects.append((x, y, w, h, int(weight)))
+        if not 0 < len(rects) <= MAX_RECTS:
+            raise ConvertError("Haar feature with %d rectangles" % len(rects))
+        features.append(rects)
+
+    for n in nodes:
+        if not 0 <= n[0] < len(features):
+            raise ConvertError("node refers to missing feature %d" % n[0])
+
+    return ftype, win_w, win_h, stages, nodes, features
+
+
+def pack(ftype, win_w, win_h, stages, nodes, features):
+    out = bytearray(struct.pack("<IHHHHHHI", MAGIC, VERSION, ftype, win_w, win_h,
+                                len(stages), len(features), len(nodes)))
+    for n_nodes, thr in stages:
+        out += struct.pack("<HHi", n_nodes, 0, thr)
+    for n in nodes:
+        if ftype == HAAR:
+            out += struct.pack("<HHiii", n[0], 0, n[1], n[2], n[3])
+        else:
+            out += struct.pack("<HHii8I", n[0], 0, n[1], n[2], *n[3])
+    for f in features:
+        if ftype == LBP:
+            out += struct.pack("<4B", *f)
+        else:
+            rects = f + [(0, 0, 0, 0, 0)] * (MAX_RECTS - len(f))
+            for x, y, w, h, weight in rects:
+                out += struct.pack("<4Bb3x", x, y, w, h, weight)
+    return bytes(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("xml", help="OpenCV cascade (opencv_traincascade format)")
+    ap.add_argument("out", help="binary cascade to write")
+    args = ap.parse_args()
+
+    try:
+        ftype, win_w, win_h, stages, nodes, features = parse(args.xml)
+    except (ConvertError, ET.ParseError, TypeError, ValueError) as e:
+        sys.exit("%s: %s" % (args.xml, e))
+
+    data = pack(ftype, win_w, win_h, stages, nodes, features)
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print("%s: %s %dx%d, %d stages, %d weak classifiers, %d features, %d bytes" % (
+        args.out, "HAAR" if ftype == HAAR else "LBP", win_w, win_h, len(stages),
+        len(nodes), len(features), len(data)))
+
+
+if __name__ == "__main__":
+    main()
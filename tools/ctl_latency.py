@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Measure control-plane latency on the ESP32-CAM while it streams at full rate.
+
+Opens --viewers /stream connections at the maximum frame rate, then times
+--count POST /servo requests (no parameters, so the servos do not move but the
+request takes the full control path) on a keep-alive connection. This runs
+once with the bandwidth shaper off and once with it on, set through POST
+/shaper, and prints round-trip percentiles next to the stream throughput of
+each run:
+
+    python3 tools/ctl_latency.py --host 192.168.1.50 --viewers 2
+
+The shaper is left as it was found.
+"""
+
+import argparse
+import http.client
+import json
+import threading
+import time
+
+
+class Viewer(threading.Thread):
+    """Reads /stream as fast as the device sends it and counts bytes."""
+
+    def __init__(self, host, port, fps):
+        super().__init__(daemon=True)
+        self.host, self.port, self.fps = host, port, fps
+        self.bytes = 0
+        self.stop = threading.Event()
+
+    def run(self):
+        conn = http.client.HTTPConnection(self.host, self.port, timeout=10)
+        conn.request("GET", "/stream?fps=%d" % self.fps)
+        resp = conn.getresponse()
+        while not self.stop.is_set():
+            chunk = resp.read1(16384)
+            if not chunk:
+                break
+            self.bytes += len(chunk)
+        conn.close()
+
+
+def get_json(host, port, path, method="GET"):
+    conn = http.client.HTTPConnection(host, port, timeout=5)
+    conn.request(method, path, body=b"" if method == "POST" else None)
+    body = conn.getresponse().read()
+    conn.close()
+    return json.loads(body)
+
+
+def percentile(sorted_ms, p):
+    return sorted_ms[min(len(sorted_ms) - 1, len(sorted_ms) * p // 100)]
+
+
+def run(args, shaper_on):
+    get_json(args.host, args.port, "/shaper?on=%d" % shaper_on, method="POST")
+
+    viewers = [Viewer(args.host, args.port, args.fps) for _ in range(args.viewers)]
+    for v in viewers:
+        v.start()
+    time.sleep(args.warmup)
+
+    ctl = http.client.HTTPConnection(args.host, args.port, timeout=5)
+    rtt_ms = []
+    failed = 0
+    start_bytes = sum(v.bytes for v in viewers)
+    t_start = time.monotonic()
+    for _ in range(args.count):
+        t0 = time.monotonic()
+        try:
+            ctl.request("POST", "/servo", body=b"")
+            ctl.getresponse().read()
+            rtt_ms.append((time.monotonic() - t0) * 1000)
+        except (OSError, http.client.HTTPException):
+            failed += 1
+            ctl.close()
+            ctl = http.client.HTTPConnection(args.host, args.port, timeout=5)
+        time.sleep(args.interval)
+    elapsed = time.monotonic() - t_start
+    stream_kBps = (sum(v.bytes for v in viewers) - start_bytes) / elapsed / 1024
+    ctl.close()
+
+    for v in viewers:
+        v.stop.set()
+    for v in viewers:
+        v.join(timeout=2)
+
+    rtt_ms.sort()
+    if not rtt_ms:
+        print("shaper %-3s  all %d requests failed" % ("on" if shaper_on else "off", failed))
+        return
+    print("shaper %-3s  p50 %6.1f  p90 %6.1f  p99 %6.1f  max %6.1f ms  "
+          "failed %d  stream %.0f kB/s" % (
+              "on" if shaper_on else "off",
+              percentile(rtt_ms, 50), percentile(rtt_ms, 90), percentile(rtt_ms, 99),
+              rtt_ms[-1], failed, stream_kBps))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", required=True)
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("--viewers", type=int, default=2, help="concurrent /stream readers")
+    ap.add_argument("--fps", type=int, default=30, help="requested stream rate")
+    ap.add_argument("--count", type=int, default=200, help="control requests per run")
+    ap.add_argument("--interval", type=float, default=0.05,
+                    help="seconds between control requests")
+    ap.add_argument("--warmup", type=float, default=2.0,
+                    help="seconds of streaming before timing starts")
+    args = ap.parse_args()
+
+    before = get_json(args.host, args.port, "/shaper")
+    try:
+        for shaper_on in (0, 1):
+            run(args, shaper_on)
+    finally:
+        get_json(args.host, args.port, "/shaper?on=%d" % before["enabled"], method="POST")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,216 @@
+// Times the face detection stage on the host: esp_jpeg_decode() at 1/4 or
+// 1/8 scale into big-endian RGB565, then the detector, as face_task.c does
+// on the device. Prints the boxes found in each image (in source pixels),
+// per-stage latency percentiles and detections per second on this machine.
+// With -c the cascade detector also reports windows per second and the share
+// of windows each cascade stage rejects.
+
+#include "face_detect.h"
+#include "jpeg_decoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define MAX_BOXES   8
+// The device lets esp_jpeg allocate its 3100 byte pool; tjpgd's tables hold
+// pointers, which are twice as big on a 64-bit host
+#define WORK_BUF_SIZE   8192
+
+static const face_detector_t *const detectors[] = {
+    &face_detector_skin,
+    &face_detector_cascade,
+};
+
+#define USAGE   "usage: %s [-s 4|8] [-n iterations] [-d detector] [-c cascade.bin]\n" \
+                "       [-t stride] [-k scale_step_q8] [-m min_neighbors] image.jpg...\n"
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t pct(int64_t *sorted, int n, int p)
+{
+    int i = n * p / 100;
+    return sorted[i < n ? i : n - 1];
+}
+
+int main(int argc, char **argv)
+{
+    int scale = 4;
+    int iters = 200;
+    const char *name = NULL;
+    const char *cascade_path = NULL;
+    cascade_params_t params = { .stride = 2, .scale_step_q8 = 307, .min_neighbors = 3 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:d:c:t:k:m:")) != -1) {
+        switch (opt) {
+        case 's': scale = atoi(optarg); break;
+        case 'n': iters = atoi(optarg); break;
+        case 'd': name = optarg; break;
+        case 'c': cascade_path = optarg; break;
+        case 't': params.stride = atoi(optarg); break;
+        case 'k': params.scale_step_q8 = atoi(optarg); break;
+        case 'm': params.min_neighbors = atoi(optarg); break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 2;
+        }
+    }
+    if ((scale != 4 && scale != 8) || iters < 1 || optind >= argc ||
+        params.stride < 1 || params.scale_step_q8 <= 256) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 2;
+    }
+    if (!name) name = cascade_path ? "cascade" : "skin";
+
+    // cascade_load() keeps pointers into the file, which stays loaded
+    cascade_t cascade;
+    static cascade_stats_t stats;
+    if (cascade_path) {
+        size_t len;
+        uint8_t *data = read_file(cascade_path, &len);
+        if (!data || !cascade_load(&cascade, data, len)) {
+            fprintf(stderr, "%s: not a cascade2bin.py cascade\n", cascade_path);
+            return 1;
+        }
+        face_cascade_set(&cascade, &params, &stats);
+    }
+
+    const face_detector_t *det = NULL;
+    for (size_t i = 0; i < sizeof(detectors) / sizeof(detectors[0]); i++) {
+        if (!strcmp(detectors[i]->name, name)) det = detectors[i];
+    }
+    if (!det) {
+        fprintf(stderr, "unknown detector '%s'\n", name);
+        return 2;
+    }
+    if (det == &face_detector_cascade && !cascade_path) {
+        fprintf(stderr, "the cascade detector needs -c cascade.bin\n");
+        return 2;
+    }
+
+    int total = iters * (argc - optind);
+    int64_t *dec = malloc(total * sizeof(int64_t));
+    int64_t *run = malloc(total * sizeof(int64_t));
+    int64_t *all = malloc(total * sizeof(int64_t));
+    int n = 0;
+    int64_t detect_total = 0;
+    int64_t wall0 = now_us();
+
+    for (int a = optind; a < argc; a++) {
+        size_t len;
+        uint8_t *jpg = read_file(argv[a], &len);
+        if (!jpg) {
+            fprintf(stderr, "%s: cannot read\n", argv[a]);
+            return 1;
+        }
+
+        static uint8_t work[WORK_BUF_SIZE];
+        esp_jpeg_image_cfg_t cfg = {
+            .indata = jpg,
+            .indata_size = len,
+            .out_format = JPEG_IMAGE_FORMAT_RGB565,
+            .out_scale = scale == 8 ? JPEG_IMAGE_SCALE_1_8 : JPEG_IMAGE_SCALE_1_4,
+            .flags.swap_color_bytes = 1,
+            .advanced.working_buffer = work,
+            .advanced.working_buffer_size = sizeof(work),
+        };
+        esp_jpeg_image_output_t img;
+        if (esp_jpeg_get_image_info(&cfg, &img) != ESP_OK) {
+            fprintf(stderr, "%s: not a baseline JPEG\n", argv[a]);
+            return 1;
+        }
+        uint8_t *rgb = malloc(img.output_len);
+        void *scratch = malloc(det->scratch_size(img.width, img.height));
+        face_box_t boxes[MAX_BOXES];
+        int count = 0;
+
+        for (int i = 0; i < iters; i++) {
+            cfg.outbuf = rgb;
+            cfg.outbuf_size = img.output_len;
+            cfg.priv.read = 0;
+
+            int64_t t0 = now_us();
+            if (esp_jpeg_decode(&cfg, &img) != ESP_OK) {
+                fprintf(stderr, "%s: decode failed\n", argv[a]);
+                return 1;
+            }
+            int64_t t1 = now_us();
+            count = det->detect(rgb, img.width, img.height, scratch, boxes, MAX_BOXES);
+            int64_t t2 = now_us();
+
+            dec[n] = t1 - t0;
+            run[n] = t2 - t1;
+            all[n] = t2 - t0;
+            detect_total += t2 - t1;
+            n++;
+        }
+
+        printf("%s: %ux%u at 1/%d, %d face(s)", argv[a], img.width * scale,
+               img.height * scale, scale, count);
+        for (int i = 0; i < count; i++) {
+            printf(" [%d,%d %dx%d s%u]", boxes[i].x * scale, boxes[i].y * scale,
+                   boxes[i].w * scale, boxes[i].h * scale, boxes[i].score);
+        }
+        printf("\n");
+
+        free(scratch);
+        free(rgb);
+        free(jpg);
+    }
+    int64_t wall = now_us() - wall0;
+
+    qsort(dec, n, sizeof(int64_t), cmp_i64);
+    qsort(run, n, sizeof(int64_t), cmp_i64);
+    qsort(all, n, sizeof(int64_t), cmp_i64);
+    printf("detector %s, %d runs\n", det->name, n);
+    printf("  decode  p50 %5lld  p99 %5lld us\n", (long long)pct(dec, n, 50), (long long)pct(dec, n, 99));
+    printf("  detect  p50 %5lld  p99 %5lld us\n", (long long)pct(run, n, 50), (long long)pct(run, n, 99));
+    printf("  total   p50 %5lld  p99 %5lld us\n", (long long)pct(all, n, 50), (long long)pct(all, n, 99));
+    printf("  %.1f detections/s\n", n * 1e6 / wall);
+
+    if (det == &face_detector_cascade) {
+        printf("cascade %s %dx%d, %d stages, stride %d, step %d/256, min_neighbors %d\n",
+               cascade.type == CASCADE_HAAR ? "Haar" : "LBP", cascade.win_w, cascade.win_h,
+               cascade.n_stages, params.stride, params.scale_step_q8, params.min_neighbors);
+        printf("  %lu windows per run, %.0f windows/s, %.4f%% pass\n",
+               (unsigned long)(stats.windows / n), stats.windows * 1e6 / detect_total,
+               stats.windows ? 100.0 * stats.hits / stats.windows : 0.0);
+        // Share of the windows reaching a stage that it rejects
+        uint32_t reaching = stats.windows;
+        for (int i = 0; i < cascade.n_stages && reaching; i++) {
+            printf("  stage %2d  reached %10lu  rejected %6.2f%%\n", i, (unsigned long)reaching,
+                   100.0 * stats.rejected[i] / reaching);
+            reaching -= stats.rejected[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdlib.h>
+#define MALLOC_CAP_DEFAULT      0
+#define heap_caps_malloc(size, caps)    malloc(size)
+#include <assert.h>
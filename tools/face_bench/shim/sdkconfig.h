@@ -0,0 +1,8 @@
+// Host build of esp_jpeg: the component's Kconfig defaults, tjpgd compiled
+// from source instead of the ROM copy
+#pragma once
+#define CONFIG_JD_SZBUF         512
+#define CONFIG_JD_FORMAT        0
+#define CONFIG_JD_USE_SCALE     1
+#define CONFIG_JD_TBLCLIP       1
+#define CONFIG_JD_FASTDECODE    1
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Receive and reassemble the ESP32-CAM UDP/multicast MJPEG stream.
+
+Joins the group, rebuilds frames from mcast_frag_hdr_t datagrams (see
+main/include/mcast_stream.h), repairs one lost fragment per FEC run from its
+XOR parity, and prints one line per second: delivered frames per second,
+frames repaired by FEC, incomplete and missing frames, and the reassembly
+latency from a frame's first datagram to its completion. With --out, the
+newest complete JPEG is written to that file.
+
+--loss drops that fraction of received datagrams before reassembly, to see
+how the stream and the FEC setting behave on a lossy link:
+
+    python3 tools/mcast_recv.py --group 239.255.0.1 --port 5005 --loss 0.05
+
+tools/mcast_send.py plays the device's side on the host, for checking loss
+recovery without the board.
+"""
+
+import argparse
+import random
+import socket
+import struct
+import time
+
+HDR = struct.Struct("<HBBIIIHHHHq")
+MAGIC = 0x4A4D
+VERSION = 2
+FLAG_PARITY = 0x01
+DATAGRAM = 1400
+FRAG_PAYLOAD = DATAGRAM - HDR.size
+
+
+class Frame:
+    def __init__(self, length, count, fec_group, t_first):
+        self.buf = bytearray(length)
+        self.length = length
+        self.count = count
+        self.fec_group = fec_group
+        self.have = set()
+        self.parity = {}        # first fragment index of the run -> payload
+        self.repaired = False
+        self.t_first = t_first
+
+    def frag_len(self, idx):
+        return min(FRAG_PAYLOAD, self.length - idx * FRAG_PAYLOAD)
+
+    def add(self, idx, payload):
+        if idx not in self.have:
+            off = idx * FRAG_PAYLOAD
+            self.buf[off:off + len(payload)] = payload
+            self.have.add(idx)
+
+    def try_repair(self, first):
+        """Rebuild the one missing fragment of the run starting at `first`."""
+        parity = self.parity.get(first)
+        if parity is None:
+            return
+        run = range(first, min(first + self.fec_group, self.count))
+        missing = [i for i in run if i not in self.have]
+        if len(missing) != 1:
+            return
+        acc = bytearray(parity)
+        for i in run:
+            if i != missing[0]:
+                off = i * FRAG_PAYLOAD
+                for k, b in enumerate(self.buf[off:off + self.frag_len(i)]):
+                    acc[k] ^= b
+        self.add(missing[0], acc[:self.frag_len(missing[0])])
+        self.repaired = True
+
+    def complete(self):
+        return len(self.have) == self.count
+
+
+class Reassembler:
+    """Rebuilds frames from datagrams in arrival order, FEC included."""
+
+    def __init__(self):
+        self.current_seq = None
+        self.frame = None       # None once the current frame is complete
+        self.last_done = None
+        self.reset_stats()
+
+    def reset_stats(self):
+        self.stats = {"complete": 0, "repaired": 0, "incomplete": 0, "missing": 0}
+        self.latency_ms = []
+
+    def feed(self, data, now):
+        """Take one datagram; returns (seq, jpeg, capture_us, repaired) when
+        it completes a frame, else None."""
+        if len(data) < HDR.size:
+            return None
+        (magic, version, flags, seq, frame_len, offset, idx, count,
+         frag_len, fec_group, capture_us) = HDR.unpack_from(data)
+        payload = data[HDR.size:HDR.size + frag_len]
+        if (magic != MAGIC or version != VERSION or len(payload) != frag_len or
+                not (flags & FLAG_PARITY or offset + frag_len <= frame_len)):
+            return None
+
+        if seq != self.current_seq:
+            # A newer frame: the old one is dropped, never waited for
+            if self.frame is not None:
+                self.stats["incomplete"] += 1
+            if self.current_seq is not None and seq > self.current_seq + 1:
+                self.stats["missing"] += seq - self.current_seq - 1
+            self.current_seq = seq
+            self.frame = Frame(frame_len, count, fec_group, now)
+
+        frame = self.frame
+        if frame is None:
+            return None
+        if flags & FLAG_PARITY:
+            frame.parity[idx] = payload
+            frame.try_repair(idx)
+        else:
+            frame.add(idx, payload)
+            if fec_group:
+                frame.try_repair(idx - idx % fec_group)
+        if not frame.complete():
+            return None
+
+        self.stats["complete"] += 1
+        self.stats["repaired"] += frame.repaired
+        self.latency_ms.append((now - frame.t_first) * 1000)
+        self.last_done = seq
+        self.frame = None
+        return seq, bytes(frame.buf), capture_us, frame.repaired
+
+
+def percentile(sorted_ms, p):
+    return sorted_ms[min(len(sorted_ms) - 1, len(sorted_ms) * p // 100)] if sorted_ms else 0
+
+
+def open_socket(group, port, iface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("", port))
+    if socket.inet_aton(group)[0] >= 224:
+        mreq = socket.inet_aton(group) + socket.inet_aton(iface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    sock.settimeout(1.0)
+    return sock
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--group", default="239.255.0.1",
+                    help="multicast group, or this host's address for unicast")
+    ap.add_argument("--port", type=int, default=5005)
+    ap.add_argument("--iface", default="0.0.0.0", help="local interface address")
+    ap.add_argument("--out", help="write the newest complete JPEG here")
+    ap.add_argument("--loss", type=float, default=0.0,
+                    help="fraction of datagrams to drop on purpose (0..1)")
+    args = ap.parse_args()
+
+    sock = open_socket(args.group, args.port, args.iface)
+    rx = Reassembler()
+    t_report = time.monotonic()
+
+    while True:
+        try:
+            data = sock.recv(2048)
+        except socket.timeout:
+            data = None
+        now = time.monotonic()
+
+        if data and random.random() >= args.loss:
+            done = rx.feed(data, now)
+            if done and args.out:
+                with open(args.out, "wb") as f:
+                    f.write(done[1])
+
+        if now - t_report >= 1.0:
+            lat = sorted(rx.latency_ms)
+            print("seq %s  fps %.1f  repaired %d  incomplete %d  missing %d  "
+                  "reassembly p50 %.1f ms p99 %.1f ms" % (
+                      rx.last_done, rx.stats["complete"] / (now - t_report),
+                      rx.stats["repaired"], rx.stats["incomplete"], rx.stats["missing"],
+                      percentile(lat, 50), percentile(lat, 99)))
+            rx.reset_stats()
+            t_report = now
+
+
+if __name__ == "__main__":
+    main()
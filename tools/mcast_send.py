@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Send fixture JPEGs as the ESP32-CAM UDP/multicast stream, from the host.
+
+Splits each JPEG into mcast_frag_hdr_t datagrams with XOR parity exactly as
+main/src/mcast_stream.c does, and drops --loss of them before they leave, so
+FEC and reassembly can be exercised without the device:
+
+    python3 tools/mcast_send.py --dest 127.0.0.1 --fec 4 --loss 0.05 --frames 500
+
+With --check (the default for a 127.x destination) tools/mcast_recv.py's
+reassembler listens on the same port in-process. Every delivered frame is
+compared byte for byte with what was sent, and the run ends with frames
+recovered by FEC, frames lost, and send-to-complete latency. It exits
+non-zero if a frame came back corrupt.
+"""
+
+import argparse
+import glob
+import os
+import random
+import socket
+import sys
+import threading
+import time
+
+from mcast_recv import (DATAGRAM, FLAG_PARITY, FRAG_PAYLOAD, HDR, MAGIC, VERSION,
+                        Reassembler, percentile)
+
+FIXTURES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "components",
+                        "esp32-camera", "test", "pictures", "*.jpeg")
+
+
+def datagrams(seq, jpeg, fec_group, capture_us):
+    """Yield the datagrams of one frame in the order the device sends them."""
+    count = (len(jpeg) + FRAG_PAYLOAD - 1) // FRAG_PAYLOAD
+    parity = bytearray()
+    first = 0
+
+    def header(flags, offset, idx, frag_len):
+        return HDR.pack(MAGIC, VERSION, flags, seq, len(jpeg), offset, idx, count,
+                        frag_len, fec_group, capture_us)
+
+    for i in range(count):
+        off = i * FRAG_PAYLOAD
+        frag = jpeg[off:off + FRAG_PAYLOAD]
+        yield header(0, off, i, len(frag)) + frag
+
+        if fec_group:
+            if i % fec_group == 0:
+                first = i
+                parity = bytearray(len(frag))
+            for k, b in enumerate(frag):
+                parity[k] ^= b
+            if i - first == fec_group - 1 or i == count - 1:
+                yield header(FLAG_PARITY, first * FRAG_PAYLOAD, first, len(parity)) + parity
+
+
+class Checker(threading.Thread):
+    """Reassembles what comes back on the loopback port and checks it."""
+
+    def __init__(self, port, sent):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+        self.sock.bind(("127.0.0.1", port))
+        self.sock.settimeout(0.2)
+        self.sent = sent        # seq -> JPEG, filled by the sender
+        self.rx = Reassembler()
+        self.repaired = 0
+        self.delivered = 0
+        self.corrupt = 0
+        self.latency_ms = []
+        self.stop = threading.Event()
+
+    def run(self):
+        while not self.stop.is_set():
+            try:
+                data = self.sock.recv(2048)
+            except socket.timeout:
+                continue
+            done = self.rx.feed(data, time.monotonic())
+            if not done:
+                continue
+            seq, jpeg, capture_us, repaired = done
+            self.delivered += 1
+            self.repaired += repaired
+            self.corrupt += jpeg != self.sent.get(seq)
+            self.latency_ms.append(time.monotonic() * 1000 - capture_us / 1000)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--dest", default="127.0.0.1", help="group or unicast address")
+    ap.add_argument("--port", type=int, default=5005)
+    ap.add_argument("--ttl", type=int, default=1)
+    ap.add_argument("--fps", type=float, default=20)
+    ap.add_argument("--frames", type=int, default=200, help="frames to send, 0 = forever")
+    ap.add_argument("--fec", type=int, default=4, help="data fragments per parity, 0 = off")
+    ap.add_argument("--loss", type=float, default=0.0,
+                    help="fraction of datagrams dropped before sending (0..1)")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--check", action=argparse.BooleanOptionalAction, default=None,
+                    help="reassemble on loopback and verify (default: on for 127.x)")
+    ap.add_argument("images", nargs="*", help="JPEGs to send (default: camera fixtures)")
+    args = ap.parse_args()
+
+    images = [open(p, "rb").read() for p in (args.images or sorted(glob.glob(FIXTURES)))]
+    if not images:
+        ap.error("no JPEGs given and no fixtures found")
+    if any(len(j) > 0xFFFF * FRAG_PAYLOAD for j in images):
+        ap.error("JPEG too large for the fragment count field")
+    check = args.check if args.check is not None else args.dest.startswith("127.")
+    random.seed(args.seed)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+    sent = {}
+    checker = None
+    if check:
+        checker = Checker(args.port, sent)
+        checker.start()
+
+    datagrams_sent = datagrams_dropped = 0
+    interval = 1.0 / args.fps
+    t_next = time.monotonic()
+    seq = 0
+    while args.frames == 0 or seq < args.frames:
+        seq += 1
+        jpeg = images[seq % len(images)]
+        sent[seq] = jpeg
+        capture_us = int(time.monotonic() * 1e6)
+        for dgram in datagrams(seq, jpeg, args.fec, capture_us):
+            if random.random() < args.loss:
+                datagrams_dropped += 1
+                continue
+            sock.sendto(dgram, (args.dest, args.port))
+            datagrams_sent += 1
+        t_next += interval
+        time.sleep(max(0.0, t_next - time.monotonic()))
+
+    print("sent %d frames, %d datagrams, %d dropped on purpose (%.1f%%), fec %d" % (
+        seq, datagrams_sent, datagrams_dropped,
+        100.0 * datagrams_dropped / max(1, datagrams_sent + datagrams_dropped), args.fec))
+    if not checker:
+        return 0
+
+    time.sleep(0.5)
+    checker.stop.set()
+    checker.join()
+    lat = sorted(checker.latency_ms)
+    print("delivered %d  recovered by FEC %d  lost %d  corrupt %d  "
+          "latency p50 %.2f ms p99 %.2f ms max %.2f ms" % (
+              checker.delivered, checker.repaired, seq - checker.delivered, checker.corrupt,
+              percentile(lat, 50), percentile(lat, 99), lat[-1] if lat else 0))
+    return 1 if checker.corrupt else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
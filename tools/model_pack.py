@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""Pack an int8 model description into the image of main/include/nn_model.h.
+
+The description is JSON. Tensors are the activations in HWC order; ops
+are listed in execution order and use the nn_op_t fields:
+
+    {
+      "name": "blazeface-front",
+      "input": 0, "output": 2,
+      "tensors": [
+        {"shape": [128, 128, 3], "zero_point": -128, "scale": 0.0039215686},
+        {"shape": [64, 64, 24], "zero_point": -128, "scale": 0.0235}
+      ],
+      "ops": [
+        {"type": "conv2d", "input": 0, "output": 1, "kernel": [5, 5],
+         "stride": 2, "pad": [1, 1], "relu": true,
+         "weights": "conv0_w.bin", "bias": "conv0_b.bin",
+         "weight_scales": [0.0021, ...]},
+        {"type": "maxpool", "input": 1, "output": 2, "kernel": [2, 2], "stride": 2}
+      ]
+    }
+
+Weights are int8 [out_c][kh][kw][in_c] (depthwise: [kh][kw][c]), and
+bias is int32. Each may be a list or the name of a raw little-endian file
+next to the JSON. Requantization is either given as "multiplier" (Q31)
+and "shift" lists, or derived TFLite-style from the tensor scales and
+per-channel "weight_scales". "relu" clamps at the output zero point, and
+"act": [min, max] gives quantized bounds.
+
+    python3 tools/model_pack.py model.json model.bin
+    python3 tools/model_pack.py --info model.bin
+
+Only the model partition needs flashing to install an image:
+
+    parttool.py write_partition --partition-name model --input model.bin
+
+The firmware checks the format version and CRC at boot, and /model
+reports what was loaded.
+"""
+
+import argparse
+import json
+import math
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = 0x444D4E4E
+VERSION = 1
+ALIGN = 16
+NONE = 0xFFFFFFFF
+MAX_TENSORS = 64
+MAX_OPS = 64        # NN_MODEL_MAX_OPS
+
+HDR = struct.Struct("<IHHIIHHHH24s")
+TENSOR = struct.Struct("<HHHbB")
+OP = struct.Struct("<8BHHIIII")
+
+OP_TYPES = {"conv2d": 0, "dwconv2d": 1, "maxpool": 2, "avgpool": 3, "relu": 4}
+OP_NAMES = {v: k for k, v in OP_TYPES.items()}
+
+
+class PackError(Exception):
+    pass
+
+
+def quantize_multiplier(real):
+    """TFLite QuantizeMultiplier: real = q / 2^31 * 2^shift, q in [2^30, 2^31)."""
+    if real <= 0:
+        return 0, 0
+    q, shift = math.frexp(real)
+    q_fixed = int(math.floor(q * (1 << 31) + 0.5))
+    if q_fixed == 1 << 31:
+        q_fixed //= 2
+        shift += 1
+    if shift < -31:
+        return 0, 0
+    if shift > 7:
+        raise PackError("effective scale %g too large" % real)
+    return q_fixed, shift
+
+
+def values(spec, key, fmt, count, base_dir, where):
+    v = spec.get(key)
+    if v is None:
+        return None
+    if isinstance(v, str):
+        with open(os.path.join(base_dir, v), "rb") as f:
+            raw = f.read()
+        size = struct.calcsize("<" + fmt)
+        if len(raw) != count * size:
+            raise PackError("%s: %s holds %d bytes, expected %d" % (where, v, len(raw), count * size))
+        v = list(struct.unpack("<%d%s" % (count, fmt), raw))
+    if len(v) != count:
+        raise PackError("%s: %s has %d values, expected %d" % (where, key, len(v), count))
+    return v
+
+
+def pack(desc, base_dir):
+    tensors = desc["tensors"]
+    ops = desc["ops"]
+    if not 0 < len(tensors) <= MAX_TENSORS or len(ops) > MAX_OPS:
+        raise PackError("%d tensors and %d ops, at most %d and %d" % (
+            len(tensors), len(ops), MAX_TENSORS, MAX_OPS))
+
+    name = desc.get("name", "").encode()
+    if len(name) > 24 or not all(c.isalnum() or c in "-_." for c in name.decode()):
+        raise PackError("name must be up to 24 of [A-Za-z0-9_.-]")
+
+    tables = HDR.size + len(tensors) * TENSOR.size + len(ops) * OP.size
+    blobs = bytearray()
+
+    def add_blob(data):
+        offset = tables + len(blobs)
+        pad = -offset % ALIGN
+        blobs.extend(b"\0" * pad)
+        offset += pad
+        blobs.extend(data)
+        return offset
+
+    op_records = []
+    for i, op in enumerate(ops):
+        where = "op %d" % i
+        kind = OP_TYPES.get(op["type"])
+        if kind is None:
+            raise PackError("%s: unknown type %r" % (where, op["type"]))
+        src, dst = tensors[op["input"]], tensors[op["output"]]
+        in_c, out_c = src["shape"][2], dst["shape"][2]
+        kh, kw = op.get("kernel", [1, 1])
+        pad_t, pad_l = op.get("pad", [0, 0])
+
+        act_min, act_max = op.get("act", [-128, 127])
+        if op.get("relu"):
+            act_min = max(act_min, dst.get("zero_point", 0))
+
+        offsets = [NONE] * 4
+        if kind in (OP_TYPES["conv2d"], OP_TYPES["dwconv2d"]):
+            n_w = kh * kw * (out_c * in_c if kind == OP_TYPES["conv2d"] else in_c)
+            weights = values(op, "weights", "b", n_w, base_dir, where)
+            if weights is None:
+                raise PackError("%s: no weights" % where)
+            bias = values(op, "bias", "i", out_c, base_dir, where)
+            mult = values(op, "multiplier", "i", out_c, base_dir, where)
+            shift = values(op, "shift", "b", out_c, base_dir, where)
+            if mult is None or shift is None:
+                scales = values(op, "weight_scales", "f", out_c, base_dir, where)
+                if scales is None or "scale" not in src or "scale" not in dst:
+                    raise PackError("%s: needs multiplier and shift, or scales" % where)
+                pairs = [quantize_multiplier(src["scale"] * s / dst["scale"]) for s in scales]
+                mult = [p[0] for p in pairs]
+                shift = [p[1] for p in pairs]
+
+            offsets[0] = add_blob(struct.pack("<%db" % n_w, *weights))
+            if bias is not None:
+                offsets[1] = add_blob(struct.pack("<%di" % out_c, *bias))
+            offsets[2] = add_blob(struct.pack("<%di" % out_c, *mult))
+            offsets[3] = add_blob(struct.pack("<%db" % out_c, *shift))
+
+        op_records.append(OP.pack(kind, kh, kw, op.get("stride", 1), pad_t, pad_l,
+                                  act_min & 0xFF, act_max & 0xFF,
+                                  op["input"], op["output"], *offsets))
+
+    body = bytearray()
+    for t in tensors:
+        h, w, c = t["shape"]
+        body += TENSOR.pack(h, w, c, t.get("zero_point", 0), 0)
+    for rec in op_records:
+        body += rec
+    body += blobs
+
+    total = HDR.size + len(body)
+    header = HDR.pack(MAGIC, VERSION, HDR.size, total, zlib.crc32(body),
+                      len(tensors), len(ops), desc["input"], desc["output"], name)
+    return header + bytes(body)
+
+
+def info(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    (magic, version, header_size, total, crc, n_tensors, n_ops, inp, out,
+     name) = HDR.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit("%s: not a model image" % path)
+    ok = version == VERSION and total <= len(data) and \
+        zlib.crc32(data[header_size:total]) == crc
+    print("%s: '%s' format v%d, %d bytes, crc32 %08x %s" % (
+        path, name.rstrip(b"\0").decode(), version, total, crc, "ok" if ok else "BAD"))
+    off = header_size
+    for i in range(n_tensors):
+        h, w, c, zp, _ = TENSOR.unpack_from(data, off)
+        off += TENSOR.size
+        tag = " input" if i == inp else " output" if i == out else ""
+        print("  tensor %2d  %3dx%3dx%-3d zp %4d%s" % (i, h, w, c, zp, tag))
+    for i in range(n_ops):
+        f = OP.unpack_from(data, off)
+        off += OP.size
+        print("  op %2d  %-8s %d -> %d  %dx%d/%d" % (i, OP_NAMES.get(f[0], "?"), f[8], f[9],
+                                                   f[1], f[2], f[3]))
+    return 0 if ok else 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--info", action="store_true", help="describe and verify an image")
+    ap.add_argument("src", help="model JSON (or the image with --info)")
+    ap.add_argument("out", nargs="?", help="image to write")
+    args = ap.parse_args()
+
+    if args.info:
+        sys.exit(info(args.src))
+    if not args.out:
+        ap.error("the output image is required")
+
+    try:
+        with open(args.src) as f:
+            desc = json.load(f)
+        image = pack(desc, os.path.dirname(os.path.abspath(args.src)))
+    except (PackError, KeyError, IndexError, ValueError, OSError, struct.error) as e:
+        sys.exit("%s: %s" % (args.src, e))
+
+    if len(image) > 0x200000:
+        sys.exit("%s: %d bytes do not fit the 2 MB model partition" % (args.out, len(image)))
+    with open(args.out, "wb") as f:
+        f.write(image)
+    print("%s: '%s', %d tensors, %d ops, %d bytes, crc32 %08x" % (
+        args.out, desc.get("name", ""), len(desc["tensors"]), len(desc["ops"]), len(image),
+        zlib.crc32(image[HDR.size:])))
+
+
+if __name__ == "__main__":
+    main()
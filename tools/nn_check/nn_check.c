@@ -0,0 +1,681 @@
+// Holds main/src/nn.c bit-exact against a naive reference on the host.
+// Every case is a random single-op model (shapes, strides, padding, zero
+// points, per-channel multipliers and shifts) run through nn_plan() and
+// nn_run() and compared element by element with the loops below, which
+// spell the arithmetic out the long way. A chained model fed through
+// nn_input_rgb565() and random branching graphs check nn_plan(): live
+// tensors must never overlap, the internal arena must keep to its budget,
+// and whatever is live after the last op must still match. Finally a
+// BlazeFace-sized block is timed and its plan printed, so kernel and
+// planner changes can be checked for speed, size and exactness in one run.
+// With -m a tools/model_pack.py image gets the same treatment instead.
+
+#include "nn.h"
+#include "nn_model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int rnd_in(int lo, int hi)
+{
+    return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// --- Reference ---
+
+static int64_t round_half_away(int64_t num, int64_t den)
+{
+    int64_t mag = ((num < 0 ? -num : num) * 2 + den) / (2 * den);
+    return num < 0 ? -mag : mag;
+}
+
+static int8_t ref_clamp(int64_t v, int lo, int hi)
+{
+    return (int8_t)(v < lo ? lo : v > hi ? hi : v);
+}
+
+static int64_t floor_div(int64_t num, int64_t den)
+{
+    return num / den - (num % den != 0 && (num < 0) != (den < 0));
+}
+
+// x * 2^shift * multiplier / 2^31 rounded half up, then the right shift
+// rounded half away from zero (gemmlowp's two roundings)
+static int8_t ref_requant(int32_t acc, int32_t mult, int shift, int zp, int lo, int hi)
+{
+    int64_t x = shift > 0 ? (int64_t)(int32_t)((uint32_t)acc << shift) : acc;
+    int64_t v = floor_div(x * mult + (1ll << 30), 1ll << 31);
+    if (v > INT32_MAX) v = INT32_MAX;
+    if (shift < 0) v = round_half_away(v, 1ll << -shift);
+    return ref_clamp(v + zp, lo, hi);
+}
+
+static int8_t at(const int8_t *t, const nn_tensor_t *d, int y, int x, int c)
+{
+    return t[((size_t)y * d->w + x) * d->c + c];
+}
+
+static void ref_op(const nn_op_t *op, const nn_tensor_t *in, const nn_tensor_t *out,
+                   const int8_t *x, int8_t *y)
+{
+    for (int oy = 0; oy < out->h; oy++) {
+        for (int ox = 0; ox < out->w; ox++) {
+            for (int o = 0; o < out->c; o++) {
+                int8_t *dst = &y[((size_t)oy * out->w + ox) * out->c + o];
+
+                if (op->type == NN_RELU) {
+                    *dst = ref_clamp(at(x, in, oy, ox, o), op->act_min, op->act_max);
+                    continue;
+                }
+
+                int64_t acc = op->bias ? op->bias[o] : 0;
+                int64_t sum = 0;
+                int count = 0;
+                int best = -128;
+                for (int ky = 0; ky < op->kh; ky++) {
+                    for (int kx = 0; kx < op->kw; kx++) {
+                        int iy = oy * op->stride - op->pad_t + ky;
+                        int ix = ox * op->stride - op->pad_l + kx;
+                        if (iy < 0 || iy >= in->h || ix < 0 || ix >= in->w) continue;
+
+                        if (op->type == NN_CONV2D) {
+                            for (int i = 0; i < in->c; i++) {
+                                int w = op->weights[((o * op->kh + ky) * op->kw + kx) * in->c + i];
+                                acc += w * (at(x, in, iy, ix, i) - in->zero_point);
+                            }
+                        } else if (op->type == NN_DWCONV2D) {
+                            int w = op->weights[(ky * op->kw + kx) * in->c + o];
+                            acc += w * (at(x, in, iy, ix, o) - in->zero_point);
+                        } else {
+                            int v = at(x, in, iy, ix, o);
+                            sum += v;
+                            if (v > best) best = v;
+                        }
+                        count++;
+                    }
+                }
+
+                if (op->type == NN_CONV2D || op->type == NN_DWCONV2D) {
+                    *dst = ref_requant((int32_t)acc, op->multiplier[o], op->shift[o],
+                                       out->zero_point, op->act_min, op->act_max);
+                } else if (op->type == NN_MAXPOOL) {
+                    *dst = ref_clamp(best, op->act_min, op->act_max);
+                } else {
+                    *dst = ref_clamp(round_half_away(sum, count), op->act_min, op->act_max);
+                }
+            }
+        }
+    }
+}
+
+static void ref_input(const nn_tensor_t *t, const uint8_t *rgb565, int width, int height,
+                      bool big_endian, int8_t *y)
+{
+    for (int ty = 0; ty < t->h; ty++) {
+        for (int tx = 0; tx < t->w; tx++) {
+            int sy = ty * height / t->h, sx = tx * width / t->w;
+            const uint8_t *px = rgb565 + ((size_t)sy * width + sx) * 2;
+            unsigned v = big_endian ? px[0] << 8 | px[1] : px[1] << 8 | px[0];
+            // Fields widened to 8 bits by repeating their top bits
+            int r = v >> 11, g = v >> 5 & 63, b = v & 31;
+            int rgb[3] = { r * 8 + r / 4, g * 4 + g / 16, b * 8 + b / 4 };
+            for (int c = 0; c < 3; c++) {
+                y[((size_t)ty * t->w + tx) * 3 + c] = ref_clamp(rgb[c] + t->zero_point, -128, 127);
+            }
+        }
+    }
+}
+
+static void arena_alloc(const nn_model_t *m, nn_arena_t *arena)
+{
+    for (int r = 0; r < NN_MEM_REGIONS; r++) {
+        size_t n = (m->arena_size[r] + NN_ARENA_ALIGN - 1) / NN_ARENA_ALIGN * NN_ARENA_ALIGN;
+        arena->base[r] = aligned_alloc(NN_ARENA_ALIGN, n ? n : NN_ARENA_ALIGN);
+        // Garbage, so reads of stale memory show up as mismatches
+        for (size_t i = 0; i < n; i++) ((uint8_t *)arena->base[r])[i] = (uint8_t)rnd();
+    }
+}
+
+static void arena_free(nn_arena_t *arena)
+{
+    for (int r = 0; r < NN_MEM_REGIONS; r++) free(arena->base[r]);
+}
+
+// --- Random cases ---
+
+typedef struct {
+    int8_t  weights[5 * 5 * 16 * 16];
+    int32_t bias[16];
+    int32_t multiplier[16];
+    int8_t  shift[16];
+} params_t;
+
+static void random_params(params_t *p, nn_op_t *op, int n_weights, int out_c)
+{
+    for (int i = 0; i < n_weights; i++) p->weights[i] = (int8_t)rnd_in(-127, 127);
+    for (int o = 0; o < out_c; o++) {
+        p->bias[o] = rnd_in(-(1 << 16), 1 << 16);
+        switch (rnd() % 8) {
+        case 0:  p->multiplier[o] = INT32_MAX; break;
+        case 1:  p->multiplier[o] = 1 << 30; break;
+        case 2:  p->multiplier[o] = 0; break;
+        default: p->multiplier[o] = (int32_t)((1u << 30) + (rnd() & ((1u << 30) - 1))); break;
+        }
+        p->shift[o] = (int8_t)rnd_in(-14, 2);
+    }
+    op->weights = p->weights;
+    op->bias = rnd() % 4 ? p->bias : NULL;
+    op->multiplier = p->multiplier;
+    op->shift = p->shift;
+}
+
+// Output size for a window, or 0 when the padding leaves an output position
+// without taps
+static int out_size(int in, int k, int stride, int pad, int pad_end)
+{
+    if (in + pad + pad_end < k) return 0;
+    int out = (in + pad + pad_end - k) / stride + 1;
+    return (out - 1) * stride - pad < in ? out : 0;
+}
+
+static const char *const op_names[] = { "conv2d", "dwconv2d", "maxpool", "avgpool", "relu" };
+
+static int compare(const char *what, const int8_t *got, const int8_t *want, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (got[i] != want[i]) {
+            printf("MISMATCH %s at %zu: got %d want %d\n", what, i, got[i], want[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int random_case(int type)
+{
+    nn_tensor_t t[2] = { 0 };
+    nn_op_t op = { .type = type, .input = 0, .output = 1 };
+    static params_t p;
+
+    t[0].h = rnd_in(1, 12);
+    t[0].w = rnd_in(1, 12);
+    t[0].c = rnd_in(1, 16);
+    t[0].zero_point = (int8_t)rnd_in(-128, 127);
+
+    if (type == NN_RELU) {
+        t[1] = t[0];
+        op.kh = op.kw = op.stride = 1;
+        // In place half the time
+        if (rnd() & 1) op.output = 0;
+    } else {
+        static const uint8_t ks[] = { 1, 2, 3, 5 };
+        op.kh = ks[rnd() % 4];
+        op.kw = ks[rnd() % 4];
+        op.stride = rnd_in(1, 2);
+        op.pad_t = rnd_in(0, op.kh - 1);
+        op.pad_l = rnd_in(0, op.kw - 1);
+        t[1].h = out_size(t[0].h, op.kh, op.stride, op.pad_t, rnd_in(0, op.kh - 1));
+        t[1].w = out_size(t[0].w, op.kw, op.stride, op.pad_l, rnd_in(0, op.kw - 1));
+        if (!t[1].h || !t[1].w) return -1;
+        t[1].c = type == NN_CONV2D ? rnd_in(1, 16) : t[0].c;
+        t[1].zero_point = type == NN_CONV2D || type == NN_DWCONV2D
+                          ? (int8_t)rnd_in(-128, 127) : t[0].zero_point;
+    }
+    if (type == NN_CONV2D) {
+        random_params(&p, &op, t[1].c * op.kh * op.kw * t[0].c, t[1].c);
+    } else if (type == NN_DWCONV2D) {
+        random_params(&p, &op, op.kh * op.kw * t[0].c, t[1].c);
+    }
+
+    op.act_min = -128;
+    op.act_max = 127;
+    if (rnd() & 1) {
+        // Fused ReLU or ReLU6-like bounds
+        op.act_min = (int8_t)rnd_in(-128, 0);
+        op.act_max = (int8_t)rnd_in(op.act_min, 127);
+    }
+
+    nn_model_t m = {
+        .n_tensors = op.output == 0 ? 1 : 2, .tensors = t,
+        .n_ops = 1, .ops = &op, .input = 0, .output = op.output,
+    };
+    if (!nn_plan(&m, rnd() & 1 ? 1 << 20 : 0)) {
+        printf("nn_plan rejected a valid %s case\n", op_names[type]);
+        return 1;
+    }
+
+    nn_arena_t arena;
+    arena_alloc(&m, &arena);
+    static int8_t input[16 * 16 * 16], want[16 * 16 * 16];
+    size_t in_len = (size_t)t[0].h * t[0].w * t[0].c;
+    size_t out_len = (size_t)t[1].h * t[1].w * t[1].c;
+    for (size_t i = 0; i < in_len; i++) input[i] = (int8_t)rnd();
+    memcpy(nn_tensor_data(&m, &arena, 0), input, in_len);
+
+    nn_run(&m, &arena);
+    ref_op(&op, &t[0], &t[1], input, want);
+    int bad = compare(op_names[type], nn_tensor_data(&m, &arena, m.output), want, out_len);
+    arena_free(&arena);
+    return bad;
+}
+
+// --- Graph checks ---
+
+static size_t tensor_len(const nn_tensor_t *t)
+{
+    return (size_t)t->h * t->w * t->c;
+}
+
+// Lifetimes worked out independently of nn.c: a tensor is needed from the
+// op writing it (-1 for the input) until its last reader, or to the end if
+// it is the output or nothing else reads it
+static void check_lifetimes(const nn_model_t *m, int *first, int *last)
+{
+    for (int t = 0; t < m->n_tensors; t++) {
+        first[t] = t == m->input ? -1 : m->n_ops;
+        last[t] = m->n_ops;
+        for (int i = m->n_ops - 1; i >= 0; i--) {
+            const nn_op_t *op = &m->ops[i];
+            if (op->output == t && i < first[t]) first[t] = i;
+        }
+        if (t == m->output) continue;
+        for (int i = m->n_ops - 1; i >= 0; i--) {
+            const nn_op_t *op = &m->ops[i];
+            if (op->input == t && op->output != t) {
+                last[t] = i;
+                break;
+            }
+        }
+        // In-place ops after the last reader still touch it
+        for (int i = 0; i < m->n_ops; i++) {
+            const nn_op_t *op = &m->ops[i];
+            if (op->input == t && op->output == t && i > last[t]) last[t] = i;
+        }
+    }
+}
+
+// Tensors live at the same time must not overlap, and all must fit
+static int check_plan(const nn_model_t *m, size_t budget)
+{
+    int first[NN_MAX_TENSORS], last[NN_MAX_TENSORS];
+    check_lifetimes(m, first, last);
+
+    if (m->arena_size[NN_MEM_INTERNAL] > budget) {
+        printf("PLAN internal arena %zu over budget %zu\n", m->arena_size[NN_MEM_INTERNAL], budget);
+        return 1;
+    }
+    for (int a = 0; a < m->n_tensors; a++) {
+        const nn_tensor_t *ta = &m->tensors[a];
+        if (ta->offset % NN_ARENA_ALIGN || ta->region >= NN_MEM_REGIONS ||
+            ta->offset + tensor_len(ta) > m->arena_size[ta->region]) {
+            printf("PLAN tensor %d misplaced\n", a);
+            return 1;
+        }
+        for (int b = a + 1; b < m->n_tensors; b++) {
+            const nn_tensor_t *tb = &m->tensors[b];
+            if (ta->region != tb->region || first[a] > last[b] || first[b] > last[a]) continue;
+            if (ta->offset < tb->offset + tensor_len(tb) && tb->offset < ta->offset + tensor_len(ta)) {
+                printf("PLAN tensors %d and %d overlap while both live\n", a, b);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Run the reference op by op, every tensor in its own buffer
+static void ref_model(const nn_model_t *m, int8_t **ref)
+{
+    for (int i = 0; i < m->n_ops; i++) {
+        const nn_op_t *op = &m->ops[i];
+        const nn_tensor_t *in = &m->tensors[op->input], *out = &m->tensors[op->output];
+        if (op->input == op->output) {
+            int8_t *tmp = malloc(tensor_len(in));
+            memcpy(tmp, ref[op->input], tensor_len(in));
+            ref_op(op, in, out, tmp, ref[op->output]);
+            free(tmp);
+        } else {
+            ref_op(op, in, out, ref[op->input], ref[op->output]);
+        }
+    }
+}
+
+// Plan with `budget`, run from `input` (or `rgb`), compare every tensor still
+// live after the last op
+static int run_and_compare(nn_model_t *m, size_t budget, const int8_t *input,
+                           const uint8_t *rgb, int img_w, int img_h, bool big_endian,
+                           const char *what)
+{
+    if (!nn_plan(m, budget)) {
+        printf("nn_plan rejected a valid %s\n", what);
+        return 1;
+    }
+    if (check_plan(m, budget)) return 1;
+
+    nn_arena_t arena;
+    arena_alloc(m, &arena);
+    int8_t *ref[NN_MAX_TENSORS];
+    for (int i = 0; i < m->n_tensors; i++) ref[i] = malloc(tensor_len(&m->tensors[i]));
+
+    const nn_tensor_t *in = &m->tensors[m->input];
+    if (rgb) {
+        nn_input_rgb565(m, &arena, rgb, img_w, img_h, big_endian);
+        ref_input(in, rgb, img_w, img_h, big_endian, ref[m->input]);
+    } else {
+        memcpy(nn_tensor_data(m, &arena, m->input), input, tensor_len(in));
+        memcpy(ref[m->input], input, tensor_len(in));
+    }
+    nn_run(m, &arena);
+    ref_model(m, ref);
+
+    int first[NN_MAX_TENSORS], last[NN_MAX_TENSORS];
+    check_lifetimes(m, first, last);
+    int bad = 0;
+    for (int i = 0; i < m->n_tensors && !bad; i++) {
+        if (last[i] < m->n_ops) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "%s tensor %d", what, i);
+        bad = compare(name, nn_tensor_data(m, &arena, i), ref[i], tensor_len(&m->tensors[i]));
+    }
+
+    for (int i = 0; i < m->n_tensors; i++) free(ref[i]);
+    arena_free(&arena);
+    return bad;
+}
+
+// Random branching graph of shape-keeping and downsampling ops, each reading
+// one of the last few tensors, so detector-style side heads come up
+#define GRAPH_MAX_OPS   24
+
+static int graph_check(void)
+{
+    static nn_tensor_t t[GRAPH_MAX_OPS + 1];
+    static nn_op_t ops[GRAPH_MAX_OPS];
+    static params_t params[GRAPH_MAX_OPS];
+    int n_ops = rnd_in(1, GRAPH_MAX_OPS);
+    int n_tensors = 1;
+
+    t[0] = (nn_tensor_t) { rnd_in(4, 16), rnd_in(4, 16), rnd_in(1, 8), (int8_t)rnd_in(-128, 127) };
+    for (int i = 0; i < n_ops; i++) {
+        int src = n_tensors - 1 - rnd_in(0, n_tensors < 3 ? n_tensors - 1 : 2);
+        const nn_tensor_t *in = &t[src];
+        nn_op_t *op = &ops[i];
+        *op = (nn_op_t) { .type = rnd_in(NN_CONV2D, NN_RELU), .input = src,
+                          .act_min = -128, .act_max = 127 };
+
+        if (op->type == NN_RELU) {
+            op->kh = op->kw = op->stride = 1;
+            op->act_min = in->zero_point;
+            if (rnd() & 1) {
+                op->output = src;   // in place
+                continue;
+            }
+            t[n_tensors] = *in;
+        } else {
+            op->kh = op->kw = rnd() & 1 ? 3 : (op->type == NN_CONV2D ? 1 : 2);
+            op->stride = in->h >= 4 && in->w >= 4 ? rnd_in(1, 2) : 1;
+            op->pad_t = op->pad_l = (op->kh - 1) / 2;
+            nn_tensor_t *out = &t[n_tensors];
+            *out = *in;
+            out->h = out_size(in->h, op->kh, op->stride, op->pad_t, op->kh - 1 - op->pad_t);
+            out->w = out_size(in->w, op->kw, op->stride, op->pad_l, op->kw - 1 - op->pad_l);
+            if (op->type == NN_CONV2D) {
+                out->c = rnd_in(1, 16);
+                random_params(&params[i], op, out->c * op->kh * op->kw * in->c, out->c);
+            } else if (op->type == NN_DWCONV2D) {
+                random_params(&params[i], op, op->kh * op->kw * in->c, out->c);
+            }
+            if (op->weights) out->zero_point = (int8_t)rnd_in(-128, 127);
+        }
+        op->output = n_tensors++;
+    }
+
+    nn_model_t m = {
+        .n_tensors = n_tensors, .tensors = t, .n_ops = n_ops, .ops = ops,
+        .input = 0, .output = ops[n_ops - 1].output,
+    };
+    static int8_t input[16 * 16 * 8];
+    for (size_t i = 0; i < tensor_len(&t[0]); i++) input[i] = (int8_t)rnd();
+
+    size_t unshared = 0;
+    for (int i = 0; i < n_tensors; i++) unshared += tensor_len(&t[i]) + NN_ARENA_ALIGN;
+    size_t budget = rnd() % 4 ? rnd() % unshared : 0;
+    return run_and_compare(&m, budget, input, NULL, 0, 0, false, "graph");
+}
+
+// --- Chained model ---
+// BlazeFace-like front: 5x5/2 conv, ReLU, then depthwise 3x3 + pointwise
+// blocks and a pooled head. Sizes are parameters so the same graph is both
+// checked small and timed at full size.
+
+#define CHAIN_OPS       8
+#define CHAIN_TENSORS   8
+
+typedef struct {
+    nn_tensor_t tensors[CHAIN_TENSORS];
+    nn_op_t ops[CHAIN_OPS];
+    params_t params[CHAIN_OPS];
+    nn_model_t m;
+    uint64_t macs;
+} chain_t;
+
+static void chain_build(chain_t *ch, int size, int width)
+{
+    nn_tensor_t *t = ch->tensors;
+    int half = size / 2, quarter = size / 4;
+
+    t[0] = (nn_tensor_t) { size, size, 3, -128 };
+    t[1] = (nn_tensor_t) { half, half, width, -5 };
+    t[2] = (nn_tensor_t) { half, half, width, 3 };
+    t[3] = (nn_tensor_t) { half, half, width, -7 };
+    t[4] = (nn_tensor_t) { quarter, quarter, width, 11 };
+    t[5] = (nn_tensor_t) { quarter, quarter, width, 11 };
+    t[6] = (nn_tensor_t) { quarter, quarter, 16, -2 };
+    t[7] = (nn_tensor_t) { quarter / 2, quarter / 2, 16, -2 };
+
+    const nn_op_t ops[CHAIN_OPS] = {
+        { NN_CONV2D,   5, 5, 2, 1, 1, -128, 127, 0, 1 },
+        { NN_RELU,     1, 1, 1, 0, 0,   -5, 127, 1, 1 },
+        { NN_DWCONV2D, 3, 3, 1, 1, 1,    3, 127, 1, 2 },
+        { NN_CONV2D,   1, 1, 1, 0, 0,   -7, 127, 2, 3 },
+        { NN_DWCONV2D, 3, 3, 2, 0, 0, -128, 127, 3, 4 },
+        { NN_MAXPOOL,  2, 2, 1, 0, 0,   11, 127, 4, 5 },
+        { NN_CONV2D,   1, 1, 1, 0, 0,   -2, 127, 5, 6 },
+        { NN_AVGPOOL,  2, 2, 2, 0, 0, -128, 127, 6, 7 },
+    };
+    memcpy(ch->ops, ops, sizeof(ops));
+    // The 2x2 pool after the strided depthwise pads on the right and bottom
+    t[5].h = out_size(t[4].h, 2, 1, 0, 1);
+    t[5].w = t[5].h;
+
+    ch->macs = 0;
+    for (int i = 0; i < CHAIN_OPS; i++) {
+        nn_op_t *op = &ch->ops[i];
+        const nn_tensor_t *in = &t[op->input], *out = &t[op->output];
+        uint64_t per_out = (uint64_t)op->kh * op->kw;
+        if (op->type == NN_CONV2D) {
+            random_params(&ch->params[i], op, out->c * op->kh * op->kw * in->c, out->c);
+            per_out *= in->c;
+        } else if (op->type == NN_DWCONV2D) {
+            random_params(&ch->params[i], op, op->kh * op->kw * in->c, out->c);
+        }
+        if (op->type != NN_RELU) ch->macs += per_out * out->h * out->w * out->c;
+        if (op->weights) {
+            // Keep activations alive through the stack: no bias, and a right
+            // shift growing with sqrt(taps) so outputs stay mid-range
+            int bits = 7;
+            for (uint64_t n = per_out; n > 1; n /= 4) bits++;
+            op->bias = NULL;
+            for (int o = 0; o < out->c; o++) ch->params[i].shift[o] = (int8_t)-rnd_in(bits, bits + 1);
+        }
+    }
+
+    ch->m = (nn_model_t) {
+        .n_tensors = CHAIN_TENSORS, .tensors = t, .n_ops = CHAIN_OPS, .ops = ch->ops,
+        .input = 0, .output = CHAIN_TENSORS - 1,
+    };
+}
+
+static int chain_check(int size, int width)
+{
+    static chain_t ch;
+    chain_build(&ch, size, width);
+
+    int img_w = rnd_in(size / 2, size * 3), img_h = rnd_in(size / 2, size * 3);
+    uint8_t *rgb = malloc((size_t)img_w * img_h * 2);
+    for (int i = 0; i < img_w * img_h * 2; i++) rgb[i] = (uint8_t)rnd();
+
+    int bad = run_and_compare(&ch.m, rnd() % (64 * 1024), NULL, rgb, img_w, img_h, rnd() & 1,
+                              "chain");
+    free(rgb);
+    return bad;
+}
+
+static void chain_time(int size, int width, int iters, size_t budget)
+{
+    static chain_t ch;
+    chain_build(&ch, size, width);
+    if (!nn_plan(&ch.m, budget)) return;
+
+    nn_arena_t arena;
+    arena_alloc(&ch.m, &arena);
+    uint8_t *rgb = calloc((size_t)size * size, 2);
+    int64_t t0 = now_us();
+    for (int i = 0; i < iters; i++) {
+        nn_input_rgb565(&ch.m, &arena, rgb, size, size, true);
+        nn_run(&ch.m, &arena);
+    }
+    double us = (double)(now_us() - t0) / iters;
+    printf("chain %dx%dx3, width %d: %.3f MMAC, %.0f us/run, %.0f MMAC/s\n",
+           size, size, width, ch.macs / 1e6, us, ch.macs / us);
+
+    static char report[8192];
+    nn_plan_json(&ch.m, report, sizeof(report));
+    printf("plan (internal budget %zu): %s\n", budget, report);
+    free(rgb);
+    arena_free(&arena);
+}
+
+// Load a packed image, check it against the reference on random input,
+// then time it and print its plan
+static int model_check(const char *path, int iters, size_t budget)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("%s: cannot read\n", path);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size_t len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    size_t cap = (len + NN_ARENA_ALIGN - 1) / NN_ARENA_ALIGN * NN_ARENA_ALIGN;
+    void *data = aligned_alloc(NN_ARENA_ALIGN, cap ? cap : NN_ARENA_ALIGN);
+    size_t got = fread(data, 1, len, f);
+    fclose(f);
+
+    static nn_tensor_t tensors[NN_MAX_TENSORS];
+    static nn_op_t ops[64];
+    nn_model_t m;
+    const char *err = got == len ? nn_model_load(data, len, &m, tensors, ops, 64) : "short read";
+    if (err) {
+        printf("%s: %s\n", path, err);
+        return 1;
+    }
+
+    const nn_tensor_t *in = &tensors[m.input];
+    int8_t *input = malloc(tensor_len(in));
+    int bad = 0;
+    for (int i = 0; i < 10 && !bad; i++) {
+        for (size_t j = 0; j < tensor_len(in); j++) input[j] = (int8_t)rnd();
+        bad = run_and_compare(&m, budget, input, NULL, 0, 0, false, path);
+    }
+    printf("%s: %d ops, %s\n", path, m.n_ops, bad ? "differs from the reference" : "bit-exact");
+
+    if (!bad && iters > 0) {
+        nn_arena_t arena;
+        arena_alloc(&m, &arena);
+        int64_t t0 = now_us();
+        for (int i = 0; i < iters; i++) nn_run(&m, &arena);
+        printf("  %.0f us/run\n", (double)(now_us() - t0) / iters);
+        arena_free(&arena);
+
+        static char report[8192];
+        nn_plan_json(&m, report, sizeof(report));
+        printf("plan (internal budget %zu): %s\n", budget, report);
+    }
+    free(input);
+    free(data);
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    int cases = 2000;
+    int iters = 20;
+    size_t budget = 64 * 1024;
+    const char *model_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:t:b:m:")) != -1) {
+        switch (opt) {
+        case 'n': cases = atoi(optarg); break;
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+        case 't': iters = atoi(optarg); break;
+        case 'b': budget = strtoul(optarg, NULL, 0); break;
+        case 'm': model_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n cases per op] [-s seed] [-t timing runs] "
+                    "[-b internal budget] [-m model.bin]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (model_path) return model_check(model_path, iters, budget);
+
+    int failed = 0;
+    for (int type = NN_CONV2D; type <= NN_RELU; type++) {
+        int done = 0;
+        while (done < cases) {
+            int r = random_case(type);
+            if (r < 0) continue;    // shape without a valid window, draw again
+            failed += r;
+            done++;
+        }
+        printf("%-9s %d cases\n", op_names[type], done);
+    }
+    for (int i = 0; i < 50; i++) {
+        failed += chain_check(rnd_in(2, 6) * 8, rnd_in(1, 16));
+    }
+    printf("chain     50 cases\n");
+    for (int i = 0; i < cases; i++) {
+        failed += graph_check();
+    }
+    printf("graph     %d cases\n", cases);
+
+    if (failed) {
+        printf("%d case(s) differ from the reference\n", failed);
+        return 1;
+    }
+    printf("bit-exact\n");
+
+    if (iters > 0) chain_time(128, 16, iters, budget);
+    return 0;
+}
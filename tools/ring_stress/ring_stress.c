@@ -0,0 +1,261 @@
+// Hammers main/src/frame_ring.c from host threads. Producers push frames
+// with unique seqs while consumers pop them, some one at a time and some
+// with frame_ring_pop_latest() as stream_task does. frame_ref_get/put are
+// replaced here by counting versions, so every frame must end up released
+// exactly once: delivered to a consumer, skipped by pop_latest, overwritten
+// by a full OVERWRITE_OLDEST ring, or left in the ring at the end. Those
+// four counts have to add up to the frames pushed, the ring's `overwritten`
+// counter has to match what it released, and each consumer has to see any
+// one producer's frames in push order: with a single producer, every
+// consumer's frames strictly increase. With BLOCK_PRODUCER every consumer
+// pops one at a time and every frame must be delivered. Producers yield after
+// about every -y pushes and spin -s iterations between pushes so consumers get a
+// real share of an overwrite run, even on one CPU; a run that delivers less
+// than -r percent of the frames fails.
+
+#include "frame_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <getopt.h>
+
+#define MAX_THREADS 16
+
+#define USAGE   "usage: %s [-p producers] [-c consumers] [-n frames_per_producer]\n" \
+                "       [-d depth] [-s spin] [-y yield_every] [-r min_delivered_pct]\n" \
+                "       [-m overwrite|block|both]\n"
+
+typedef struct {
+    frame_ref_t ref;
+    atomic_uint delivered;      // handed to a consumer
+    atomic_uint released;       // reference count reached zero
+} frame_t;
+
+static frame_t *frames;
+static uint32_t n_frames;
+static uint32_t per_producer;
+static uint32_t spin;
+static uint32_t yield_every;    // average pushes between yields, 0 = never
+static uint32_t min_pct;
+static bool all_pop;            // no pop_latest consumers
+
+static frame_ring_t ring;
+static atomic_int producers_left;
+static atomic_uint skipped_total;
+static atomic_uint push_timeouts;
+static atomic_uint errors;
+
+static void fail(const char *fmt, uint32_t seq)
+{
+    if (atomic_fetch_add(&errors, 1) < 10) {
+        fprintf(stderr, fmt, (unsigned long)seq);
+    }
+}
+
+frame_ref_t *frame_ref_get(frame_ref_t *ref)
+{
+    atomic_fetch_add(&ref->refs, 1);
+    return ref;
+}
+
+void frame_ref_put(frame_ref_t *ref)
+{
+    if (!ref) return;
+    unsigned was = atomic_fetch_sub(&ref->refs, 1);
+    if (was == 0) {
+        fail("frame %lu released more often than referenced\n", ref->seq);
+    } else if (was == 1) {
+        atomic_fetch_add(&((frame_t *)ref)->released, 1);
+    }
+}
+
+// Producer p owns seqs p * per_producer .. (p + 1) * per_producer - 1
+static void *producer(void *arg)
+{
+    int p = (int)(intptr_t)arg;
+    unsigned seed = p + 1;
+    for (uint32_t i = 0; i < per_producer; i++) {
+        frame_ref_t *ref = &frames[p * per_producer + i].ref;
+        while (frame_ring_push(&ring, ref, 100) == ESP_ERR_TIMEOUT) {
+            atomic_fetch_add(&push_timeouts, 1);
+        }
+        for (volatile uint32_t k = 0; k < spin; k++) {
+        }
+        // At random, once per yield_every pushes on average, so the ring
+        // sees every mix of full, overwritten and drained
+        if (yield_every && rand_r(&seed) % yield_every == 0) {
+            sched_yield();
+        }
+    }
+    atomic_fetch_sub(&producers_left, 1);
+    return NULL;
+}
+
+static void take(frame_ref_t *ref, uint32_t *last)
+{
+    uint32_t seq = ref->seq;
+    int p = seq / per_producer;
+    if (atomic_fetch_add(&frames[seq].delivered, 1) != 0) {
+        fail("frame %lu delivered twice\n", seq);
+    }
+    if (last[p] != UINT32_MAX && seq <= last[p]) {
+        fail("frame %lu out of push order\n", seq);
+    }
+    last[p] = seq;
+    frame_ref_put(ref);
+}
+
+// Even consumers pop one frame at a time, odd ones drain with pop_latest
+static void *consumer(void *arg)
+{
+    bool latest = !all_pop && ((intptr_t)arg & 1);
+    uint32_t last[MAX_THREADS];
+    for (int i = 0; i < MAX_THREADS; i++) last[i] = UINT32_MAX;
+
+    for (;;) {
+        // Read the producer count first so a push it covers is not missed
+        bool done = atomic_load(&producers_left) == 0;
+        frame_ref_t *ref;
+        if (latest) {
+            uint32_t skipped = 0;
+            ref = frame_ring_pop_latest(&ring, &skipped);
+            atomic_fetch_add(&skipped_total, skipped);
+        } else {
+            ref = frame_ring_pop(&ring);
+        }
+        if (ref) {
+            take(ref, last);
+        } else if (done) {
+            return NULL;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static int run(frame_ring_policy_t policy, int producers, int consumers, uint32_t depth)
+{
+    const char *name = policy == FRAME_RING_OVERWRITE_OLDEST ? "overwrite" : "block";
+
+    for (uint32_t i = 0; i < n_frames; i++) {
+        frames[i].ref.seq = i;
+        atomic_store(&frames[i].ref.refs, 1);   // the producer's reference
+        atomic_store(&frames[i].delivered, 0);
+        atomic_store(&frames[i].released, 0);
+    }
+    if (frame_ring_init(&ring, depth, policy) != ESP_OK) return 1;
+    atomic_store(&producers_left, producers);
+    atomic_store(&skipped_total, 0);
+    atomic_store(&push_timeouts, 0);
+    atomic_store(&errors, 0);
+    all_pop = policy == FRAME_RING_BLOCK_PRODUCER;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_t threads[2 * MAX_THREADS];
+    for (int i = 0; i < producers; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < consumers; i++) {
+        pthread_create(&threads[producers + i], NULL, consumer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < producers + consumers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Whatever the consumers left behind
+    uint32_t left = 0;
+    frame_ref_t *ref;
+    while ((ref = frame_ring_pop(&ring)) != NULL) {
+        left++;
+        frame_ref_put(ref);
+    }
+
+    uint32_t delivered = 0, lost = 0, dup = 0, undelivered_released = 0;
+    for (uint32_t i = 0; i < n_frames; i++) {
+        unsigned rel = atomic_load(&frames[i].released);
+        delivered += atomic_load(&frames[i].delivered) != 0;
+        lost += rel == 0;
+        dup += rel > 1;
+        undelivered_released += rel && !atomic_load(&frames[i].delivered);
+        if (atomic_load(&frames[i].ref.refs) != 0) fail("frame %lu still referenced\n", i);
+    }
+    uint32_t overwritten = atomic_load(&ring.overwritten);
+    uint32_t skipped = atomic_load(&skipped_total);
+
+    if (lost) fail("%lu frames never released\n", lost);
+    if (dup) fail("%lu frames released twice\n", dup);
+    if (delivered + skipped + overwritten + left != n_frames) {
+        fail("delivered + skipped + overwritten + left != %lu pushed\n", n_frames);
+    }
+    if (undelivered_released != skipped + overwritten + left) {
+        fail("ring released %lu frames nobody was told about\n",
+             undelivered_released - (skipped + overwritten + left));
+    }
+    if (policy == FRAME_RING_BLOCK_PRODUCER && delivered != n_frames) {
+        fail("block policy delivered %lu frames too few\n", n_frames - delivered);
+    }
+    if ((uint64_t)delivered * 100 < (uint64_t)n_frames * min_pct) {
+        fail("only %lu frames delivered, consumers barely ran\n", delivered);
+    }
+
+    double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    unsigned bad = atomic_load(&errors);
+    printf("%-9s depth %lu  %dp/%dc  %lu frames  delivered %lu  skipped %lu  overwritten %lu  "
+           "left %lu  push timeouts %u  %.1f Mframes/s  %s\n",
+           name, (unsigned long)depth, producers, consumers, (unsigned long)n_frames,
+           (unsigned long)delivered, (unsigned long)skipped, (unsigned long)overwritten,
+           (unsigned long)left, atomic_load(&push_timeouts), n_frames / s / 1e6,
+           bad ? "FAIL" : "ok");
+    return bad != 0;
+}
+
+int main(int argc, char **argv)
+{
+    int producers = 2, consumers = 2;
+    uint32_t depth = 4;
+    const char *mode = "both";
+    per_producer = 200000;
+    spin = 200;
+    yield_every = 4;
+    min_pct = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:n:d:s:y:r:m:")) != -1) {
+        switch (opt) {
+        case 'p': producers = atoi(optarg); break;
+        case 'c': consumers = atoi(optarg); break;
+        case 'n': per_producer = strtoul(optarg, NULL, 10); break;
+        case 'd': depth = strtoul(optarg, NULL, 10); break;
+        case 's': spin = strtoul(optarg, NULL, 10); break;
+        case 'y': yield_every = strtoul(optarg, NULL, 10); break;
+        case 'r': min_pct = strtoul(optarg, NULL, 10); break;
+        case 'm': mode = optarg; break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 2;
+        }
+    }
+    if (producers < 1 || producers > MAX_THREADS || consumers < 1 ||
+        consumers > MAX_THREADS || per_producer < 1) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 2;
+    }
+
+    n_frames = producers * per_producer;
+    frames = calloc(n_frames, sizeof(*frames));
+    if (!frames) return 1;
+
+    int bad = 0;
+    if (strcmp(mode, "block") != 0) {
+        bad |= run(FRAME_RING_OVERWRITE_OLDEST, producers, consumers, depth);
+    }
+    if (strcmp(mode, "overwrite") != 0) {
+        bad |= run(FRAME_RING_BLOCK_PRODUCER, producers, consumers, depth);
+    }
+    free(frames);
+    return bad;
+}
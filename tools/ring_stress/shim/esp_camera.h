@@ -0,0 +1,6 @@
+// Only what frame_ref.h needs; the stress test never touches a frame buffer
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+typedef struct camera_fb_t camera_fb_t;
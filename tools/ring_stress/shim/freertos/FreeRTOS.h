@@ -0,0 +1,19 @@
+// One tick per millisecond of CLOCK_MONOTONIC
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   ((TickType_t)0xFFFFFFFF)
+
+static inline TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
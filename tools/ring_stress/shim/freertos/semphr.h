@@ -0,0 +1,59 @@
+// Binary semaphore on a pthread mutex and condition variable
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            given;
+} host_sem_t;
+typedef host_sem_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    host_sem_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return s;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    pthread_mutex_lock(&s->lock);
+    bool was = s->given;
+    s->given = true;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return was ? pdFALSE : pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += ticks / 1000;
+    until.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    int err = 0;
+    while (!s->given && err != ETIMEDOUT) {
+        err = ticks == portMAX_DELAY ? pthread_cond_wait(&s->cond, &s->lock)
+                                     : pthread_cond_timedwait(&s->cond, &s->lock, &until);
+    }
+    bool taken = s->given;
+    s->given = false;
+    pthread_mutex_unlock(&s->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,268 @@
+// Serves fixture JPEGs as RTP/JPEG (RFC 2435) over UDP from the host, through
+// main/src/rtp_jpeg.c exactly as rtsp_server.c drives it on the device, so
+// the packetizer can be checked with ffprobe/ffplay without the board.
+//
+// Every packet is also checked here before it goes out: RTP version and
+// payload type, consecutive sequence numbers, one timestamp per frame, the
+// marker bit on the last packet only, fragment offsets that follow the bytes
+// already sent, the quantization table header on the first packet only, the
+// restart header when the frame has DRI, and the payload size limit. The
+// scan data collected from the packets has to equal the JPEG's byte for
+// byte. With -o the SDP describing the stream is written for ffprobe.
+
+#include "rtp_jpeg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define MAX_IMAGES  16
+#define SSRC        0x45535033u     // "ESP3"
+
+#define USAGE   "usage: %s [-a addr] [-p port] [-f fps] [-n frames] [-w wait_ms]\n" \
+                "       [-o stream.sdp] image.jpg...\n"
+
+typedef struct {
+    const rtp_jpeg_info_t *info;
+    uint32_t ts;
+    uint16_t next_seq;
+    bool     seq_known;
+    size_t   off;               // scan bytes seen so far in this frame
+    bool     marker_seen;
+    int      packets;
+    uint8_t *scan;              // reassembled scan data
+    int      sock;
+    struct sockaddr_in dest;
+    int      errors;
+} check_t;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = n > 0 ? malloc(n) : NULL;
+    if (buf && fread(buf, 1, n, f) != (size_t)n) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = n;
+    return buf;
+}
+
+static uint32_t be(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    while (n--) v = v << 8 | *p++;
+    return v;
+}
+
+#define EXPECT(cond, ...) do { \
+        if (!(cond)) { \
+            if (c->errors++ < 10) { \
+                fprintf(stderr, "packet %d: ", c->packets); \
+                fprintf(stderr, __VA_ARGS__); \
+                fputc('\n', stderr); \
+            } \
+        } } while (0)
+
+// rtp_send_fn: flatten, check against RFC 2435 and send
+static esp_err_t check_send(void *ctx, const struct iovec *iov, int iovcnt, size_t len)
+{
+    check_t *c = ctx;
+    const rtp_jpeg_info_t *info = c->info;
+    uint8_t pkt[12 + RTP_JPEG_MAX_PAYLOAD + 64];
+
+    size_t n = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (n + iov[i].iov_len > sizeof(pkt)) {
+            EXPECT(false, "larger than 12 + %d bytes", RTP_JPEG_MAX_PAYLOAD);
+            return ESP_FAIL;
+        }
+        memcpy(pkt + n, iov[i].iov_base, iov[i].iov_len);
+        n += iov[i].iov_len;
+    }
+    EXPECT(n == len, "len %zu, iovs hold %zu", len, n);
+    EXPECT(n - 12 <= RTP_JPEG_MAX_PAYLOAD, "payload %zu > %d", n - 12, RTP_JPEG_MAX_PAYLOAD);
+
+    // RTP header
+    uint16_t seq = be(pkt + 2, 2);
+    bool marker = pkt[1] & 0x80;
+    EXPECT(pkt[0] == 0x80, "V/P/X/CC byte 0x%02x", pkt[0]);
+    EXPECT((pkt[1] & 0x7F) == RTP_PT_JPEG, "payload type %d", pkt[1] & 0x7F);
+    EXPECT(!c->seq_known || seq == c->next_seq, "seq %u, expected %u", seq, c->next_seq);
+    EXPECT(be(pkt + 4, 4) == c->ts, "timestamp changed within the frame");
+    EXPECT(be(pkt + 8, 4) == SSRC, "ssrc 0x%08x", be(pkt + 8, 4));
+    EXPECT(!c->marker_seen, "packet after the marker");
+    c->next_seq = seq + 1;
+    c->seq_known = true;
+
+    // Main JPEG header
+    const uint8_t *p = pkt + 12;
+    uint32_t frag_off = be(p + 1, 3);
+    EXPECT(p[0] == 0, "type-specific %d", p[0]);
+    EXPECT(frag_off == c->off, "fragment offset %u, %zu bytes sent", frag_off, c->off);
+    EXPECT(p[4] == info->type, "type %d, frame is %d", p[4], info->type);
+    EXPECT(p[5] == 255, "Q %d, tables must travel in-band", p[5]);
+    EXPECT(p[6] == info->width8 && p[7] == info->height8, "size %dx%d blocks", p[6], p[7]);
+    p += 8;
+
+    if (info->type >= 64) {
+        EXPECT(be(p, 2) == info->dri, "restart interval %u, frame has %u", be(p, 2), info->dri);
+        EXPECT(be(p + 2, 2) == 0xFFFF, "F/L/count 0x%04x", be(p + 2, 2));
+        p += 4;
+    }
+
+    if (frag_off == 0) {
+        EXPECT(p[0] == 0 && p[1] == 0, "quant header MBZ/precision %d/%d", p[0], p[1]);
+        EXPECT(be(p + 2, 2) == 64u * info->nqt, "quant length %u", be(p + 2, 2));
+        for (int i = 0; i < info->nqt; i++) {
+            EXPECT(memcmp(p + 4 + 64 * i, info->qt[i], 64) == 0, "quant table %d differs", i);
+        }
+        p += 4 + 64 * info->nqt;
+    }
+
+    size_t chunk = pkt + n - p;
+    if (c->off + chunk <= info->scan_len) {
+        memcpy(c->scan + c->off, p, chunk);
+    } else {
+        EXPECT(false, "scan data runs past %zu bytes", info->scan_len);
+    }
+    c->off += chunk;
+    EXPECT(marker == (c->off == info->scan_len), "marker %d at %zu of %zu bytes",
+           marker, c->off, info->scan_len);
+    c->marker_seen = marker;
+    c->packets++;
+
+    if (c->sock >= 0) {
+        sendto(c->sock, pkt, n, 0, (struct sockaddr *)&c->dest, sizeof(c->dest));
+    }
+    return ESP_OK;
+}
+
+static int write_sdp(const char *path, const char *addr, int port)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "v=0\r\n"
+               "o=- 0 0 IN IP4 %s\r\n"
+               "s=rtp_check\r\n"
+               "c=IN IP4 %s\r\n"
+               "t=0 0\r\n"
+               "m=video %d RTP/AVP %d\r\n"
+               "a=rtpmap:%d JPEG/%d\r\n",
+            addr, addr, port, RTP_PT_JPEG, RTP_PT_JPEG, RTP_JPEG_CLOCK_HZ);
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = "127.0.0.1";
+    const char *sdp = NULL;
+    int port = 5004;
+    int fps = 10;
+    int frames = 50;
+    int wait_ms = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:f:n:w:o:")) != -1) {
+        switch (opt) {
+        case 'a': addr = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'f': fps = atoi(optarg); break;
+        case 'n': frames = atoi(optarg); break;
+        case 'w': wait_ms = atoi(optarg); break;
+        case 'o': sdp = optarg; break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 2;
+        }
+    }
+    int n_images = argc - optind;
+    if (n_images < 1 || n_images > MAX_IMAGES || fps < 1 || frames < 0) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 2;
+    }
+
+    uint8_t *jpeg[MAX_IMAGES];
+    rtp_jpeg_info_t info[MAX_IMAGES];
+    for (int i = 0; i < n_images; i++) {
+        const char *path = argv[optind + i];
+        size_t len;
+        jpeg[i] = read_file(path, &len);
+        if (!jpeg[i]) {
+            fprintf(stderr, "%s: cannot read\n", path);
+            return 1;
+        }
+        esp_err_t err = rtp_jpeg_parse(jpeg[i], len, &info[i]);
+        if (err != ESP_OK) {
+            fprintf(stderr, "%s: rtp_jpeg_parse failed (0x%x)\n", path, err);
+            return 1;
+        }
+        printf("%s: type %d, %dx%d, %d quant tables, dri %u, %zu scan bytes\n", path,
+               info[i].type, info[i].width8 * 8, info[i].height8 * 8, info[i].nqt,
+               info[i].dri, info[i].scan_len);
+    }
+
+    if (sdp && write_sdp(sdp, addr, port) != 0) {
+        fprintf(stderr, "%s: cannot write\n", sdp);
+        return 1;
+    }
+
+    check_t c = { .sock = socket(AF_INET, SOCK_DGRAM, 0) };
+    c.dest.sin_family = AF_INET;
+    c.dest.sin_port = htons(port);
+    if (c.sock < 0 || inet_pton(AF_INET, addr, &c.dest.sin_addr) != 1) {
+        fprintf(stderr, "cannot send to %s:%d\n", addr, port);
+        return 1;
+    }
+    usleep(wait_ms * 1000);
+
+    rtp_stream_t rs = { .seq = 0xFFF0, .ssrc = SSRC };    // wraps within the first frames
+    int packets = 0, bad_frames = 0;
+    int64_t start = now_us();
+    for (int f = 0; f < frames; f++) {
+        const rtp_jpeg_info_t *fi = &info[f % n_images];
+        c.info = fi;
+        c.ts = rtp_jpeg_timestamp((int64_t)f * 1000000 / fps);
+        c.off = 0;
+        c.marker_seen = false;
+        c.scan = malloc(fi->scan_len);
+        int errors = c.errors;
+
+        esp_err_t err = rtp_jpeg_send_frame(&rs, fi, c.ts, check_send, &c);
+        if (err != ESP_OK || !c.marker_seen || c.off != fi->scan_len ||
+            memcmp(c.scan, fi->scan, fi->scan_len) != 0) {
+            c.errors++;
+        }
+        bad_frames += c.errors != errors;
+        packets = c.packets;
+        free(c.scan);
+
+        int64_t due = start + (int64_t)(f + 1) * 1000000 / fps;
+        int64_t now = now_us();
+        if (due > now) usleep(due - now);
+    }
+
+    printf("%d frames, %d packets to %s:%d, %d bad frames: %s\n", frames, packets, addr, port,
+           bad_frames, c.errors ? "FAIL" : "ok");
+    for (int i = 0; i < n_images; i++) free(jpeg[i]);
+    close(c.sock);
+    return c.errors != 0;
+}